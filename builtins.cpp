@@ -0,0 +1,70 @@
+#include <cmath>
+#include <cstring>
+
+#include "llvm/IR/Intrinsics.h"
+
+#include "builtins.hpp"
+
+using namespace llvm;
+
+#pragma region BUILTIN_TABLE
+
+using Fn1 = double (*)(double);
+using Fn2 = double (*)(double, double);
+using Fn3 = double (*)(double, double, double);
+
+// the static_casts pick the C double overload out of <cmath>
+#define MODK_LIBM1(name) #name, reinterpret_cast<void *>(static_cast<Fn1>(&::name))
+#define MODK_LIBM2(name) #name, reinterpret_cast<void *>(static_cast<Fn2>(&::name))
+#define MODK_LIBM3(name) #name, reinterpret_cast<void *>(static_cast<Fn3>(&::name))
+
+const BuiltinFunction Builtins[] = {
+	{"sqrt", 1, [](const double * a) { return std::sqrt(a[0]); }, Intrinsic::sqrt, MODK_LIBM1(sqrt)},
+	{"abs", 1, [](const double * a) { return std::fabs(a[0]); }, Intrinsic::fabs, nullptr, nullptr},
+	{"floor", 1, [](const double * a) { return std::floor(a[0]); }, Intrinsic::floor, MODK_LIBM1(floor)},
+	{"ceil", 1, [](const double * a) { return std::ceil(a[0]); }, Intrinsic::ceil, MODK_LIBM1(ceil)},
+	{"trunc", 1, [](const double * a) { return std::trunc(a[0]); }, Intrinsic::trunc, MODK_LIBM1(trunc)},
+	{"round", 1, [](const double * a) { return std::round(a[0]); }, Intrinsic::round, MODK_LIBM1(round)},
+
+	{"sin", 1, [](const double * a) { return std::sin(a[0]); }, Intrinsic::sin, MODK_LIBM1(sin)},
+	{"cos", 1, [](const double * a) { return std::cos(a[0]); }, Intrinsic::cos, MODK_LIBM1(cos)},
+	{"exp", 1, [](const double * a) { return std::exp(a[0]); }, Intrinsic::exp, MODK_LIBM1(exp)},
+	{"exp2", 1, [](const double * a) { return std::exp2(a[0]); }, Intrinsic::exp2, MODK_LIBM1(exp2)},
+	{"log", 1, [](const double * a) { return std::log(a[0]); }, Intrinsic::log, MODK_LIBM1(log)},
+	{"log2", 1, [](const double * a) { return std::log2(a[0]); }, Intrinsic::log2, MODK_LIBM1(log2)},
+	{"log10", 1, [](const double * a) { return std::log10(a[0]); }, Intrinsic::log10, MODK_LIBM1(log10)},
+
+	{"pow", 2, [](const double * a) { return std::pow(a[0], a[1]); }, Intrinsic::pow, MODK_LIBM2(pow)},
+	{"min", 2, [](const double * a) { return std::fmin(a[0], a[1]); }, Intrinsic::minnum, MODK_LIBM2(fmin)},
+	{"max", 2, [](const double * a) { return std::fmax(a[0], a[1]); }, Intrinsic::maxnum, MODK_LIBM2(fmax)},
+	{"copysign", 2, [](const double * a) { return std::copysign(a[0], a[1]); },
+		Intrinsic::copysign, nullptr, nullptr},
+
+	{"fma", 3, [](const double * a) { return std::fma(a[0], a[1], a[2]); }, Intrinsic::fma, MODK_LIBM3(fma)},
+};
+
+#undef MODK_LIBM1
+#undef MODK_LIBM2
+#undef MODK_LIBM3
+
+const size_t NumBuiltins = sizeof(Builtins) / sizeof(Builtins[0]);
+
+int FindBuiltin(const std::string & _name, const size_t _argc) {
+	for(size_t i {0}; i != NumBuiltins; ++i) {
+		if(Builtins[i].m_Argc == _argc && !strcmp(Builtins[i].m_Name, _name.c_str()))
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+bool IsReservedName(const std::string & _name) {
+	for(size_t i {0}; i != NumBuiltins; ++i) {
+		if(_name == Builtins[i].m_Name || (Builtins[i].m_Symbol && _name == Builtins[i].m_Symbol))
+			return true;
+	}
+
+	return false;
+}
+
+#pragma endregion
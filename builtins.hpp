@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// The math library. Builtins aren't ModK functions, the JIT lowers
+// calls to them straight to LLVM intrinsics (llvm.sqrt, llvm.sin, ...)
+// so the optimizer knows exactly what they compute, and the interpreter
+// runs them through m_Eval with a single CallBuiltin instruction
+struct BuiltinFunction {
+	const char * m_Name;
+	unsigned m_Argc;
+
+	// reads m_Argc arguments starting at _args
+	double (*m_Eval)(const double * _args);
+
+	// llvm::Intrinsic::ID, kept as a plain number so the interpreter
+	// doesn't need any LLVM headers to use the table
+	unsigned m_Intrinsic;
+
+	// the libm function an intrinsic becomes when the target has no
+	// instruction for it, nullptr if it's always expanded inline
+	const char * m_Symbol;
+	void * m_Address;
+};
+
+extern const BuiltinFunction Builtins[];
+extern const size_t NumBuiltins;
+
+// index into Builtins, -1 if there's no builtin _name taking _argc
+int FindBuiltin(const std::string & _name, const size_t _argc);
+
+// builtin names and the libm symbols behind them can't be defined as
+// ModK functions, the JIT'd code for a builtin may call the symbol
+bool IsReservedName(const std::string & _name);
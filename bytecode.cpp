@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cstring>
+
+#include "builtins.hpp"
+#include "bytecode.hpp"
+#include "memo.hpp"
+
+TierUpFunction TierUpHook {nullptr};
+uint32_t TierUpThreshold {1000};
+int64_t ConstEvalBudget {1'000'000};
+
+#pragma region BYTECODE_MODULE
+
+BytecodeFunction * BytecodeModule::declare(const std::string & _name) {
+	if(auto it = m_Index.find(_name); it != m_Index.end())
+		return m_Functions[it->second].get();
+
+	// call operands only have 16 bits for the callee
+	if(m_Functions.size() > UINT16_MAX)
+		return nullptr;
+
+	m_Index[_name] = static_cast<uint16_t>(m_Functions.size());
+	m_Functions.push_back(std::make_unique<BytecodeFunction>());
+	m_Functions.back()->m_Name = _name;
+
+	return m_Functions.back().get();
+}
+
+BytecodeFunction * BytecodeModule::lookup(const std::string & _name) const {
+	int idx = indexOf(_name);
+	return idx < 0 ? nullptr : m_Functions[idx].get();
+}
+
+int BytecodeModule::indexOf(const std::string & _name) const {
+	auto it = m_Index.find(_name);
+	return it == m_Index.end() ? -1 : it->second;
+}
+
+#pragma endregion
+
+#pragma region BYTECODE_COMPILER
+
+BytecodeCompiler::BytecodeCompiler(const BytecodeModule & _module, BytecodeFunction & _fn,
+		const std::vector<std::string> & _params, const unsigned _hoisted_literals)
+	: m_Module {_module}, m_Function {_fn}, m_NumHoisted {_hoisted_literals} {
+
+	for(unsigned i {0}; i != m_NumHoisted; ++i)
+		allocate();
+
+	// parameters live in the first registers so a caller can
+	// hand its argument registers over as the callee's frame
+	for(const auto & param : _params)
+		m_Params[param] = static_cast<uint8_t>(allocate());
+
+	m_Function.m_NumParams = static_cast<uint8_t>(std::min<size_t>(m_NumHoisted + _params.size(),
+				MaxRegisters));
+}
+
+int BytecodeCompiler::lookupVariable(const std::string & _name) const {
+	auto it = m_Params.find(_name);
+	return it == m_Params.end() ? -1 : it->second;
+}
+
+int BytecodeCompiler::lookupFunction(const std::string & _name, const size_t _argc) const {
+	int idx = m_Module.indexOf(_name);
+	if(idx < 0)
+		return -1;
+
+	// the function being lowered is already declared but has no
+	// code yet, which is fine since that's just recursion
+	const BytecodeFunction & callee = m_Module.at(idx);
+	if(&callee != &m_Function && !callee.callable())
+		return -1;
+
+	return callee.m_NumParams == _argc ? idx : -1;
+}
+
+int BytecodeCompiler::allocate() {
+	if(m_Top >= MaxRegisters) {
+		m_Failed = true;
+		return -1;
+	}
+
+	m_NumRegisters = std::max<uint8_t>(m_NumRegisters, m_Top + 1);
+	return m_Top++;
+}
+
+int BytecodeCompiler::nextHoistedLiteral() {
+	if(m_NextHoisted >= m_NumHoisted || m_NextHoisted >= MaxRegisters)
+		return -1;
+
+	return m_NextHoisted++;
+}
+
+int BytecodeCompiler::constantIndex(const double _value) {
+	auto & constants = m_Constants;
+
+	// compared bitwise so -0.0 and NaN payloads survive
+	auto it = std::find_if(constants.begin(), constants.end(), [&](double k) {
+		return std::memcmp(&k, &_value, sizeof(double)) == 0;
+	});
+
+	size_t k_idx = it - constants.begin();
+	if(it == constants.end()) {
+		if(constants.size() > UINT16_MAX) {
+			m_Failed = true;
+			return -1;
+		}
+
+		constants.push_back(_value);
+	}
+
+	return static_cast<int>(k_idx);
+}
+
+int BytecodeCompiler::emitConstant(const double _value) {
+	int k_idx = constantIndex(_value);
+	if(k_idx < 0)
+		return -1;
+
+	int dst = allocate();
+	if(dst < 0)
+		return -1;
+
+	emit(OpCode::LoadK, dst, k_idx);
+	return dst;
+}
+
+void BytecodeCompiler::emit(const OpCode _op, const int _a, const int _b, const int _c) {
+	m_Code.push_back({_op, static_cast<uint8_t>(_a),
+			static_cast<uint16_t>(_b), static_cast<uint16_t>(_c)});
+}
+
+size_t BytecodeCompiler::emitJump(const OpCode _op, const int _a) {
+	emit(_op, _a);
+	return m_Code.size() - 1;
+}
+
+void BytecodeCompiler::patch(const size_t _jump) {
+	// targets are 16 bits like every other operand
+	if(m_Code.size() > UINT16_MAX) {
+		m_Failed = true;
+		return;
+	}
+
+	m_Code[_jump].B = static_cast<uint16_t>(m_Code.size());
+	m_Label = m_Code.size();
+}
+
+bool BytecodeCompiler::isConstant(const int _reg, double & _value) const {
+	if(_reg < 0 || m_Code.empty() || m_Code.back().Op != OpCode::LoadK || m_Code.back().A != _reg
+			|| m_Label == m_Code.size())
+		return false;
+
+	_value = m_Constants[m_Code.back().B];
+	return true;
+}
+
+bool BytecodeCompiler::finish(const int _result) {
+	if(_result < 0 || m_Failed)
+		return false;
+
+	emit(OpCode::Ret, _result);
+
+	m_Function.m_Code = std::move(m_Code);
+	m_Function.m_Constants = std::move(m_Constants);
+	m_Function.m_NumRegisters = m_NumRegisters;
+
+	return true;
+}
+
+#pragma endregion
+
+#pragma region INTERPRETER
+
+// every interpreter frame lives on one register stack per thread, a
+// call's argument registers double as the callee's first registers
+// so arguments are never copied
+static constexpr size_t StackSlots = 1 << 16;
+
+static thread_local std::unique_ptr<double[]> RegisterStack;
+static thread_local double * StackTop {nullptr};
+static thread_local unsigned CallDepth {0};
+
+// per evaluation state, m_Budget is null outside of compile time
+// evaluation and m_TierUp is off there so codegen is never re-entered
+struct ExecState {
+	const BytecodeModule & m_Module;
+	int64_t * m_Budget;
+	bool m_TierUp;
+};
+
+// computed goto is a GNU extension, anything else gets the switch
+#if defined(__GNUC__) || defined(__clang__)
+#define MODK_COMPUTED_GOTO 1
+#endif
+
+#ifdef MODK_COMPUTED_GOTO
+#define VM_DISPATCH() goto *DispatchTable[static_cast<uint8_t>(ip->Op)]
+#define VM_LOOP() VM_DISPATCH();
+#define VM_CASE(op) L_##op:
+#define VM_NEXT() ++ip; VM_DISPATCH()
+#define VM_JUMP(target) ip = code + (target); VM_DISPATCH()
+#else
+#define VM_LOOP() for(;;) switch(ip->Op)
+#define VM_CASE(op) case OpCode::op:
+#define VM_NEXT() ++ip; continue
+#define VM_JUMP(target) ip = code + (target); continue
+#endif
+
+static bool Execute(ExecState & _state, const BytecodeFunction & _fn,
+		double * _regs, double & _result) {
+
+	const BytecodeInstruction * const code = _fn.m_Code.data();
+	const BytecodeInstruction * ip = code;
+	const double * k = _fn.m_Constants.data();
+	double * const stack_end = RegisterStack.get() + StackSlots;
+
+#ifdef MODK_COMPUTED_GOTO
+	// must stay in the same order as OpCode
+	static const void * const DispatchTable[] = {
+		&&L_LoadK, &&L_Move, &&L_Add, &&L_Sub, &&L_Mul,
+		&&L_CmpLT, &&L_CmpLE, &&L_CmpEQ, &&L_CmpNE,
+		&&L_Jump, &&L_JumpIfFalse, &&L_JumpIfTrue,
+		&&L_Call, &&L_CallBuiltin, &&L_Ret,
+	};
+	static_assert(sizeof(DispatchTable) / sizeof(void *) ==
+			static_cast<size_t>(OpCode::Count), "dispatch table out of sync with OpCode");
+#endif
+
+	VM_LOOP() {
+		VM_CASE(LoadK) {
+			_regs[ip->A] = k[ip->B];
+			VM_NEXT();
+		}
+
+		VM_CASE(Move) {
+			_regs[ip->A] = _regs[ip->B];
+			VM_NEXT();
+		}
+
+		VM_CASE(Add) {
+			_regs[ip->A] = _regs[ip->B] + _regs[ip->C];
+			VM_NEXT();
+		}
+
+		VM_CASE(Sub) {
+			_regs[ip->A] = _regs[ip->B] - _regs[ip->C];
+			VM_NEXT();
+		}
+
+		VM_CASE(Mul) {
+			_regs[ip->A] = _regs[ip->B] * _regs[ip->C];
+			VM_NEXT();
+		}
+
+		VM_CASE(CmpLT) {
+			_regs[ip->A] = _regs[ip->B] < _regs[ip->C] ? 1.0 : 0.0;
+			VM_NEXT();
+		}
+
+		VM_CASE(CmpLE) {
+			_regs[ip->A] = _regs[ip->B] <= _regs[ip->C] ? 1.0 : 0.0;
+			VM_NEXT();
+		}
+
+		VM_CASE(CmpEQ) {
+			_regs[ip->A] = _regs[ip->B] == _regs[ip->C] ? 1.0 : 0.0;
+			VM_NEXT();
+		}
+
+		VM_CASE(CmpNE) {
+			_regs[ip->A] = _regs[ip->B] != _regs[ip->C] ? 1.0 : 0.0;
+			VM_NEXT();
+		}
+
+		VM_CASE(Jump) {
+			VM_JUMP(ip->B);
+		}
+
+		VM_CASE(JumpIfFalse) {
+			if(_regs[ip->A] == 0.0) {
+				VM_JUMP(ip->B);
+			}
+
+			VM_NEXT();
+		}
+
+		VM_CASE(JumpIfTrue) {
+			if(_regs[ip->A] != 0.0) {
+				VM_JUMP(ip->B);
+			}
+
+			VM_NEXT();
+		}
+
+		VM_CASE(CallBuiltin) {
+			_regs[ip->A] = Builtins[ip->B].m_Eval(_regs + ip->A);
+			VM_NEXT();
+		}
+
+		VM_CASE(Call) {
+			BytecodeFunction & callee = _state.m_Module.at(ip->B);
+			double * frame = _regs + ip->A;
+
+			// compile time evaluation leaves the counters alone, it can
+			// run on several codegen threads at once
+			if(_state.m_TierUp && !callee.m_Native && ++callee.m_CallCount == TierUpThreshold
+					&& TierUpHook)
+				TierUpHook(callee);
+
+			// the caches and their hit rates are for calls the program
+			// makes, compile time evaluation goes around them
+			MemoCache * memo = _state.m_TierUp ? callee.m_Memo : nullptr;
+
+			// promoted @memo functions do their own caching
+			if(callee.m_Native && (memo || !callee.m_Memo)
+					&& CallNative(callee.m_Native, ip->C, frame, frame[0])) {
+				VM_NEXT();
+			}
+
+			// the frame's argument registers get clobbered by the
+			// callee, so the key has to be saved off for the store
+			double memo_key[MaxMemoArgs];
+			if(memo) {
+				if(memo->lookup(frame, frame[0])) {
+					VM_NEXT();
+				}
+
+				std::copy(frame, frame + ip->C, memo_key);
+			}
+
+			if(callee.m_Code.empty() || frame + callee.m_NumRegisters > stack_end
+					|| CallDepth >= MaxCallDepth) [[unlikely]]
+				return false;
+
+			// charging whole functions per call keeps the budget out
+			// of every other instruction, there are no loops to miss
+			if(_state.m_Budget && (*_state.m_Budget -= callee.m_Code.size()) < 0) [[unlikely]]
+				return false;
+
+			double * saved_top = StackTop;
+			StackTop = std::max(StackTop, frame + callee.m_NumRegisters);
+
+			++CallDepth;
+			bool ok = Execute(_state, callee, frame, frame[0]);
+			--CallDepth;
+
+			StackTop = saved_top;
+
+			if(!ok)
+				return false;
+
+			if(memo)
+				memo->store(memo_key, frame[0]);
+
+			VM_NEXT();
+		}
+
+		VM_CASE(Ret) {
+			_result = _regs[ip->A];
+			return true;
+		}
+
+#ifndef MODK_COMPUTED_GOTO
+		default:
+			return false;
+#endif
+	}
+
+	return false;
+}
+
+#undef VM_DISPATCH
+#undef VM_LOOP
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_JUMP
+
+static bool Run(ExecState & _state, const BytecodeFunction & _fn,
+		const double * _args, double & _result) {
+
+	if(!RegisterStack) {
+		RegisterStack = std::make_unique<double[]>(StackSlots);
+		StackTop = RegisterStack.get();
+	}
+
+	if(_fn.m_Code.empty() || StackTop + _fn.m_NumRegisters > RegisterStack.get() + StackSlots)
+		return false;
+
+	// start above whatever frames are live, codegen can end up back
+	// in here while a tier-up is running underneath an outer call
+	double * frame = StackTop;
+	std::copy(_args, _args + _fn.m_NumParams, frame);
+
+	StackTop = frame + _fn.m_NumRegisters;
+	bool ok = Execute(_state, _fn, frame, _result);
+	StackTop = frame;
+
+	return ok;
+}
+
+bool Interpret(const BytecodeModule & _module, const BytecodeFunction & _fn,
+		const double * _args, double & _result) {
+
+	ExecState state {_module, nullptr, true};
+	return Run(state, _fn, _args, _result);
+}
+
+bool IsConstEvaluable(const BytecodeModule & _module, const BytecodeFunction & _fn) {
+	std::vector<const BytecodeFunction *> worklist {&_fn};
+	std::vector<bool> seen(_module.size());
+
+	while(!worklist.empty()) {
+		const BytecodeFunction * fn = worklist.back();
+		worklist.pop_back();
+
+		if(fn->m_Code.empty())
+			return false;
+
+		for(const BytecodeInstruction & inst : fn->m_Code) {
+			if(inst.Op != OpCode::Call || seen[inst.B])
+				continue;
+
+			seen[inst.B] = true;
+			worklist.push_back(&_module.at(inst.B));
+		}
+	}
+
+	return true;
+}
+
+bool Evaluate(const BytecodeModule & _module, const BytecodeFunction & _fn,
+		const double * _args, const int64_t _budget, double & _result) {
+
+	if(!IsConstEvaluable(_module, _fn))
+		return false;
+
+	int64_t budget = _budget - static_cast<int64_t>(_fn.m_Code.size());
+	if(budget < 0)
+		return false;
+
+	ExecState state {_module, &budget, false};
+	return Run(state, _fn, _args, _result);
+}
+
+bool CallNative(void * _fn, const unsigned _argc, const double * _args, double & _result) {
+	using D = double;
+	const double * a = _args;
+
+	switch(_argc) {
+		case 0:
+			_result = reinterpret_cast<D (*)()>(_fn)();
+			return true;
+
+		case 1:
+			_result = reinterpret_cast<D (*)(D)>(_fn)(a[0]);
+			return true;
+
+		case 2:
+			_result = reinterpret_cast<D (*)(D, D)>(_fn)(a[0], a[1]);
+			return true;
+
+		case 3:
+			_result = reinterpret_cast<D (*)(D, D, D)>(_fn)(a[0], a[1], a[2]);
+			return true;
+
+		case 4:
+			_result = reinterpret_cast<D (*)(D, D, D, D)>(_fn)(a[0], a[1], a[2], a[3]);
+			return true;
+
+		case 5:
+			_result = reinterpret_cast<D (*)(D, D, D, D, D)>(_fn)(a[0], a[1], a[2], a[3], a[4]);
+			return true;
+
+		case 6:
+			_result = reinterpret_cast<D (*)(D, D, D, D, D, D)>(_fn)(a[0], a[1], a[2], a[3],
+					a[4], a[5]);
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Register based bytecode for the interpreter tier. Every definition
+// gets lowered to this first so cold code runs without ever touching
+// LLVM, only functions that get called often enough are handed to the
+// JIT and from then on the interpreter calls straight into native code
+//
+// operands follow the usual A/B/C layout, A is always a register and
+// B/C are registers, constant indices or function indices depending
+// on the opcode (see the comments below)
+//
+// jumps only ever go forward, B is the absolute index of the target
+// and a register counts as false only when it's 0.0 (NaN is true)
+enum class OpCode : uint8_t {
+	LoadK,		// R[A] = K[B]
+	Move,		// R[A] = R[B]
+	Add,		// R[A] = R[B] + R[C]
+	Sub,		// R[A] = R[B] - R[C]
+	Mul,		// R[A] = R[B] * R[C]
+	CmpLT,		// R[A] = R[B] < R[C] ? 1.0 : 0.0
+	CmpLE,		// R[A] = R[B] <= R[C] ? 1.0 : 0.0
+	CmpEQ,		// R[A] = R[B] == R[C] ? 1.0 : 0.0
+	CmpNE,		// R[A] = R[B] != R[C] ? 1.0 : 0.0
+	Jump,		// goto B
+	JumpIfFalse,	// if R[A] == 0.0 goto B
+	JumpIfTrue,	// if R[A] != 0.0 goto B
+	Call,		// R[A] = F[B](R[A] ... R[A + C - 1])
+	CallBuiltin,	// R[A] = Builtins[B](R[A] ... R[A + C - 1])
+	Ret,		// return R[A]
+
+	Count
+};
+
+struct BytecodeInstruction {
+	OpCode Op;
+	uint8_t A;
+	uint16_t B;
+	uint16_t C;
+};
+
+// registers are a byte wide, anything that needs more than this
+// is left to the JIT
+constexpr unsigned MaxRegisters = 255;
+
+// the most arguments the interpreter knows how to pass when calling
+// into native code, functions with more stay interpreted
+constexpr unsigned MaxNativeArgs = 6;
+
+class MemoCache;
+
+// what a function is known not to do, filled in by InferEffects()
+// and attached as attributes whenever the function is codegen'd
+struct FunctionEffects {
+	bool m_ReadNone {false};
+	bool m_NoUnwind {false};
+	bool m_WillReturn {false};
+	bool m_Speculatable {false};
+
+	bool operator==(const FunctionEffects &) const = default;
+};
+
+struct BytecodeFunction {
+	std::string m_Name {};
+	uint8_t m_NumParams {0};
+	uint8_t m_NumRegisters {0};
+
+	std::vector<BytecodeInstruction> m_Code;
+	std::vector<double> m_Constants;
+
+	// tiering state, m_Native is filled in once the function has
+	// been promoted and is called instead of the bytecode
+	uint32_t m_CallCount {0};
+	void * m_Native {nullptr};
+
+	FunctionEffects m_Effects {};
+	bool m_EffectsKnown {false};
+
+	// set for @memo functions that turned out to be pure
+	MemoCache * m_Memo {nullptr};
+
+	bool callable() const { return m_Native || !m_Code.empty(); }
+};
+
+// owns every function the interpreter knows about, calls refer to
+// their callee by index so slots are never removed once declared
+class BytecodeModule {
+	std::vector<std::unique_ptr<BytecodeFunction>> m_Functions;
+	std::map<std::string, uint16_t> m_Index;
+
+	public:
+		// reserves (or reuses) the slot for _name so recursive calls
+		// can be resolved while the body is still being lowered
+		BytecodeFunction * declare(const std::string & _name);
+
+		BytecodeFunction * lookup(const std::string & _name) const;
+		int indexOf(const std::string & _name) const;
+
+		BytecodeFunction & at(const uint16_t _index) const { return *m_Functions[_index]; }
+		size_t size() const { return m_Functions.size(); }
+};
+
+// helper the AST nodes use to lower themselves, hands out registers
+// in stack order so temporaries are reused as soon as they're consumed
+class BytecodeCompiler {
+	const BytecodeModule & m_Module;
+	BytecodeFunction & m_Function;
+
+	// built up on the side and only committed by finish(), so nothing
+	// evaluated mid-lowering can ever run a half built function
+	std::vector<BytecodeInstruction> m_Code;
+	std::vector<double> m_Constants;
+	uint8_t m_NumRegisters {0};
+
+	std::map<std::string, uint8_t> m_Params;
+	unsigned m_Top {0};
+	bool m_Failed {false};
+
+	// hoisted literals come in as the leading parameters
+	unsigned m_NumHoisted {0};
+	unsigned m_NextHoisted {0};
+
+	// where the last jump was patched to, a LoadK right before a jump
+	// target isn't the only way to reach there so it proves nothing
+	size_t m_Label {SIZE_MAX};
+
+	public:
+		BytecodeCompiler(const BytecodeModule & _module, BytecodeFunction & _fn,
+				const std::vector<std::string> & _params, const unsigned _hoisted_literals = 0);
+
+		const BytecodeModule & module() const { return m_Module; }
+		const BytecodeFunction & function() const { return m_Function; }
+
+		// both return -1 when the name can't be resolved
+		int lookupVariable(const std::string & _name) const;
+		int lookupFunction(const std::string & _name, const size_t _argc) const;
+
+		unsigned top() const { return m_Top; }
+		void reset(const unsigned _top) { m_Top = _top; }
+
+		int allocate();
+		int emitConstant(const double _value);
+
+		// index of _value in the constant pool, adding it if needed
+		int constantIndex(const double _value);
+
+		// register of the next hoisted literal, -1 when not hoisting
+		int nextHoistedLiteral();
+		void emit(const OpCode _op, const int _a, const int _b = 0, const int _c = 0);
+
+		// emits a jump with its target left open, patch() points it at
+		// whatever gets emitted next
+		size_t emitJump(const OpCode _op, const int _a = 0);
+		void patch(const size_t _jump);
+
+		// true if _reg was just loaded from the constant pool, i.e. the
+		// expression that produced it folded down to _value
+		bool isConstant(const int _reg, double & _value) const;
+
+		size_t mark() const { return m_Code.size(); }
+		void rewind(const size_t _mark) { m_Code.resize(_mark); }
+
+		// emits the return and commits the code, on failure the function
+		// is left as it was so callers can fall back to the JIT
+		bool finish(const int _result);
+};
+
+// called when a function crosses TierUpThreshold calls, returns
+// true if it managed to fill in BytecodeFunction::m_Native
+using TierUpFunction = bool (*)(BytecodeFunction &);
+
+extern TierUpFunction TierUpHook;
+extern uint32_t TierUpThreshold;
+
+// how many instructions a single compile time evaluation may run
+// before it's abandoned and the call is left for runtime
+extern int64_t ConstEvalBudget;
+
+// interpreted calls nest on the C++ stack, this keeps runaway
+// recursion from taking the whole process down with it
+constexpr unsigned MaxCallDepth = 4096;
+
+// runs _fn with _args (one per parameter), returns false if the
+// interpreter had to bail out, i.e. stack overflow or a call to a
+// function that was declared but never successfully defined
+bool Interpret(const BytecodeModule & _module, const BytecodeFunction & _fn,
+		const double * _args, double & _result);
+
+// true if everything _fn can reach is bytecode, which makes it pure
+// and therefore safe to run while compiling
+bool IsConstEvaluable(const BytecodeModule & _module, const BytecodeFunction & _fn);
+
+// compile time evaluation, like Interpret but charged against
+// _budget and without tiering anything up along the way
+bool Evaluate(const BytecodeModule & _module, const BytecodeFunction & _fn,
+		const double * _args, const int64_t _budget, double & _result);
+
+// calls a JIT'd double(double...) function, returns false if it
+// takes more arguments than we have call shapes for
+bool CallNative(void * _fn, const unsigned _argc, const double * _args, double & _result);
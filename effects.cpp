@@ -0,0 +1,79 @@
+#include "effects.hpp"
+
+using namespace llvm;
+
+#pragma region EFFECT_INFERENCE
+
+void InferEffects(BytecodeModule & _module) {
+	std::vector<BytecodeFunction *> pending;
+
+	for(size_t i {0}, e = _module.size(); i != e; ++i) {
+		BytecodeFunction & fn = _module.at(i);
+		if(fn.m_EffectsKnown)
+			continue;
+
+		// optimistic for memory and unwinding (greatest fixpoint, so a
+		// recursive call can't spoil them) and pessimistic for returning
+		// (least fixpoint, so anything on a cycle never gets willreturn)
+		fn.m_Effects = {};
+		if(!fn.m_Code.empty()) {
+			fn.m_Effects.m_ReadNone = true;
+			fn.m_Effects.m_NoUnwind = true;
+		}
+
+		pending.push_back(&fn);
+	}
+
+	bool changed {true};
+	while(changed) {
+		changed = false;
+
+		for(BytecodeFunction * fn : pending) {
+			if(fn->m_Code.empty())
+				continue;
+
+			// arithmetic on doubles never traps, so only calls matter
+			FunctionEffects effects {true, true, true, true};
+
+			for(const BytecodeInstruction & inst : fn->m_Code) {
+				if(inst.Op != OpCode::Call)
+					continue;
+
+				const FunctionEffects & callee = _module.at(inst.B).m_Effects;
+				effects.m_ReadNone &= callee.m_ReadNone;
+				effects.m_NoUnwind &= callee.m_NoUnwind;
+				effects.m_WillReturn &= callee.m_WillReturn;
+				effects.m_Speculatable &= callee.m_Speculatable;
+			}
+
+			effects.m_Speculatable &= effects.m_WillReturn && effects.m_ReadNone;
+
+			if(effects != fn->m_Effects) {
+				fn->m_Effects = effects;
+				changed = true;
+			}
+		}
+	}
+
+	for(BytecodeFunction * fn : pending)
+		fn->m_EffectsKnown = true;
+}
+
+void ApplyEffects(Function & _fn, const FunctionEffects & _effects) {
+	if(_effects.m_ReadNone) {
+		_fn.setDoesNotAccessMemory();
+		_fn.addFnAttr(Attribute::NoSync);
+		_fn.addFnAttr(Attribute::NoFree);
+	}
+
+	if(_effects.m_NoUnwind)
+		_fn.setDoesNotThrow();
+
+	if(_effects.m_WillReturn)
+		_fn.addFnAttr(Attribute::WillReturn);
+
+	if(_effects.m_Speculatable)
+		_fn.addFnAttr(Attribute::Speculatable);
+}
+
+#pragma endregion
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "llvm/IR/Function.h"
+
+#include "bytecode.hpp"
+
+// Effect inference over the bytecode call graph. ModK code itself
+// can't touch memory or throw, so a function only loses these facts
+// by (transitively) calling something we have no bytecode for, and
+// only loses willreturn/speculatable by sitting on a call cycle
+//
+// fills in m_Effects for every function that doesn't have them yet,
+// call it after each batch of definitions has been lowered
+void InferEffects(BytecodeModule & _module);
+
+// attaches whatever was inferred as LLVM function attributes
+void ApplyEffects(llvm::Function & _fn, const FunctionEffects & _effects);
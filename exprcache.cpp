@@ -0,0 +1,54 @@
+#include <cstring>
+
+#include "exprcache.hpp"
+
+size_t ExpressionCacheCapacity {1024};
+
+#pragma region AST_FINGERPRINT
+
+void AstFingerprint::raw(const void * _data, const size_t _size) {
+	m_Bytes.append(static_cast<const char *>(_data), _size);
+}
+
+void AstFingerprint::tag(const NodeTag _tag) {
+	m_Bytes.push_back(static_cast<char>(_tag));
+}
+
+void AstFingerprint::integer(const uint32_t _value) {
+	raw(&_value, sizeof(_value));
+}
+
+void AstFingerprint::number(const double _value) {
+	if(m_HoistLiterals) {
+		m_Literals.push_back(_value);
+		return;
+	}
+
+	// bitwise, 0.0 and -0.0 are different expressions
+	raw(&_value, sizeof(_value));
+}
+
+void AstFingerprint::name(const std::string & _name) {
+	integer(static_cast<uint32_t>(_name.size()));
+	m_Bytes += _name;
+}
+
+void AstFingerprint::bind(const std::string & _name) {
+	const uint32_t idx = static_cast<uint32_t>(m_Bindings.size());
+	m_Bindings[_name] = idx;
+}
+
+void AstFingerprint::variable(const std::string & _name) {
+	auto it = m_Bindings.find(_name);
+
+	if(it == m_Bindings.end()) {
+		tag(NodeTag::FreeVariable);
+		name(_name);
+		return;
+	}
+
+	tag(NodeTag::Variable);
+	integer(it->second);
+}
+
+#pragma endregion
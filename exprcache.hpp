@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Canonical byte encoding of an AST, built by the nodes' fingerprint()
+// methods. Bound variables are written as the index of their binder
+// rather than by name, so expressions that only differ in what their
+// variables are called come out identical (alpha-normalized). Being
+// the full encoding rather than just a hash it can be used as a cache
+// key directly without ever mistaking one expression for another
+enum class NodeTag : uint8_t {
+	Number,
+	String,
+	Variable,
+	FreeVariable,
+	Binary,
+	Call,
+	Function,
+	If,
+	FPMode,
+	BranchHint,
+};
+
+class AstFingerprint {
+	std::string m_Bytes {};
+	std::map<std::string, uint32_t> m_Bindings;
+	bool m_Valid {true};
+
+	// with literal hoisting on, numbers are collected here instead of
+	// being written out, so expressions that only differ in their
+	// literals share one encoding (and one compiled kernel)
+	bool m_HoistLiterals {false};
+	std::vector<double> m_Literals;
+
+	void raw(const void * _data, const size_t _size);
+
+	public:
+		// the mode goes first so a hoisted encoding can never be
+		// mistaken for a specialized one
+		explicit AstFingerprint(const bool _hoist_literals = false)
+			: m_Bytes(1, _hoist_literals ? 'h' : 's'), m_HoistLiterals {_hoist_literals} {}
+
+		void tag(const NodeTag _tag);
+		void integer(const uint32_t _value);
+		void number(const double _value);
+
+		// global names (callees), written out in full
+		void name(const std::string & _name);
+
+		// binds _name to the next binder index, then variable() refers
+		// to it by that index instead of by name
+		void bind(const std::string & _name);
+		void variable(const std::string & _name);
+
+		// for nodes that don't know how to fingerprint themselves
+		void invalidate() { m_Valid = false; }
+
+		bool valid() const { return m_Valid; }
+		const std::string & bytes() const { return m_Bytes; }
+
+		// in the order the nodes were visited, which is also the order
+		// codegen and the bytecode compiler bind them in
+		const std::vector<double> & literals() const { return m_Literals; }
+};
+
+// default bound on compiled expressions kept around
+extern size_t ExpressionCacheCapacity;
+
+// Thread safe LRU map, values are handed out by copy (shared_ptrs in
+// practice) so evicting an entry never pulls it out from under a
+// thread that's still using it. Evicted values are destroyed outside
+// the lock since tearing down compiled code can take a while
+template <typename Key, typename Value>
+class LruCache {
+	using Entry = std::pair<Key, Value>;
+
+	mutable std::mutex m_Mutex;
+	size_t m_Capacity {0};
+
+	std::list<Entry> m_Order;
+	std::unordered_map<Key, typename std::list<Entry>::iterator> m_Index;
+
+	uint64_t m_Hits {0};
+	uint64_t m_Misses {0};
+
+	public:
+		explicit LruCache(const size_t _capacity) : m_Capacity {_capacity} {}
+
+		std::optional<Value> lookup(const Key & _key) {
+			std::lock_guard<std::mutex> lock {m_Mutex};
+
+			auto it = m_Index.find(_key);
+			if(it == m_Index.end()) {
+				++m_Misses;
+				return std::nullopt;
+			}
+
+			++m_Hits;
+			m_Order.splice(m_Order.begin(), m_Order, it->second);
+			return it->second->second;
+		}
+
+		void insert(const Key & _key, Value _value) {
+			std::vector<Value> evicted;
+
+			{
+				std::lock_guard<std::mutex> lock {m_Mutex};
+
+				if(auto it = m_Index.find(_key); it != m_Index.end()) {
+					evicted.push_back(std::move(it->second->second));
+					it->second->second = std::move(_value);
+					m_Order.splice(m_Order.begin(), m_Order, it->second);
+					return;
+				}
+
+				m_Order.emplace_front(_key, std::move(_value));
+				m_Index[_key] = m_Order.begin();
+
+				while(m_Order.size() > m_Capacity) {
+					evicted.push_back(std::move(m_Order.back().second));
+					m_Index.erase(m_Order.back().first);
+					m_Order.pop_back();
+				}
+			}
+		}
+
+		void clear() {
+			std::list<Entry> dropped;
+
+			{
+				std::lock_guard<std::mutex> lock {m_Mutex};
+				dropped.swap(m_Order);
+				m_Index.clear();
+			}
+		}
+
+		size_t size() const {
+			std::lock_guard<std::mutex> lock {m_Mutex};
+			return m_Order.size();
+		}
+
+		uint64_t getHits() const {
+			std::lock_guard<std::mutex> lock {m_Mutex};
+			return m_Hits;
+		}
+
+		uint64_t getMisses() const {
+			std::lock_guard<std::mutex> lock {m_Mutex};
+			return m_Misses;
+		}
+};
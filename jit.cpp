@@ -0,0 +1,479 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/IPO/HotColdSplitting.h"
+#include "llvm/Transforms/Scalar/EarlyCSE.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+#include "builtins.hpp"
+#include "jit.hpp"
+#include "jitmem.hpp"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+bool FastCompile {false};
+bool VectorizeMath {false};
+bool PooledCodeMemory {true};
+bool HugePages {false};
+bool SplitColdCode {false};
+
+#pragma region JIT_IMPL
+
+// hands lookups for anything the JITDylib doesn't define yet to the
+// driver, which is how interpreted callees of a promoted function
+// get compiled only once something actually needs them natively
+class FallbackGenerator : public DefinitionGenerator {
+	ModKJIT::SymbolFallback m_Fallback;
+	char m_GlobalPrefix {};
+
+	public:
+		FallbackGenerator(ModKJIT::SymbolFallback _fallback, const char _prefix)
+			: m_Fallback {std::move(_fallback)}, m_GlobalPrefix {_prefix} {}
+
+		Error tryToGenerate(LookupState &, LookupKind, JITDylib &, JITDylibLookupFlags,
+				const SymbolLookupSet & _symbols) override {
+
+			for(const auto & kv : _symbols) {
+				StringRef name = *kv.first;
+
+				if(m_GlobalPrefix && !name.empty() && name.front() == m_GlobalPrefix)
+					name = name.drop_front();
+
+				m_Fallback(name);
+			}
+
+			return Error::success();
+		}
+};
+
+Expected<std::unique_ptr<ModKJIT>> ModKJIT::Create(SymbolFallback _fallback,
+		const unsigned _compile_threads) {
+	auto jtmb = JITTargetMachineBuilder::detectHost();
+	if(!jtmb)
+		return jtmb.takeError();
+
+	if(FastCompile) {
+		jtmb->setCodeGenOptLevel(CodeGenOpt::None);
+		jtmb->getOptions().EnableFastISel = true;
+	}
+
+	auto target_builder = std::make_unique<JITTargetMachineBuilder>(*jtmb);
+
+	// same layer LLJIT would make, only with the pool behind it
+	std::shared_ptr<CodeMemoryPool> pool;
+	LLJITBuilder::ObjectLinkingLayerCreator pooled_layer;
+
+	if(PooledCodeMemory) {
+		pool = std::make_shared<CodeMemoryPool>(HugePages);
+		pooled_layer = [pool](ExecutionSession & _es, const Triple & _triple)
+				-> Expected<std::unique_ptr<ObjectLayer>> {
+			auto layer = std::make_unique<RTDyldObjectLinkingLayer>(_es, [pool]() {
+				return std::make_unique<PooledMemoryManager>(pool);
+			});
+
+			if(_triple.isOSBinFormatCOFF()) {
+				layer->setOverrideObjectFlagsWithResponsibilityFlags(true);
+				layer->setAutoClaimResponsibilityForObjectSymbols(true);
+			}
+
+			return layer;
+		};
+	}
+
+	auto jit = LLJITBuilder()
+		.setJITTargetMachineBuilder(std::move(*jtmb))
+		.setNumCompileThreads(_compile_threads)
+		.setObjectLinkingLayerCreator(std::move(pooled_layer))
+		.create();
+	if(!jit)
+		return jit.takeError();
+
+	auto res = std::make_unique<ModKJIT>();
+	res->m_JIT = std::move(*jit);
+	res->m_CodeMemory = std::move(pool);
+	res->m_TargetBuilder = std::move(target_builder);
+
+	// a TargetMachine isn't safe to share between threads, so whichever
+	// thread optimizes (a compile thread, or the one that looked the
+	// symbol up) builds its own the first time, which keeps Create down
+	// to the one TargetMachine LLJIT's compiler needs
+	ModKJIT * self = res.get();
+	res->m_JIT->getIRTransformLayer().setTransform(
+		[self](ThreadSafeModule _tsm, const MaterializationResponsibility &)
+				-> Expected<ThreadSafeModule> {
+			auto target = self->getThreadTargetMachine();
+			if(!target)
+				return target.takeError();
+
+			_tsm.withModuleDo([&](Module & m) { OptimizeModule(m, *target); });
+			return _tsm;
+		}
+	);
+
+	// whatever libm calls the builtins' intrinsics turn into resolve from
+	// a dylib of their own, so nothing JIT'd can ever clash with them
+	JITDylib & runtime = res->m_JIT->getExecutionSession().createBareJITDylib("modk.runtime");
+	res->m_Runtime = &runtime;
+
+	SymbolMap libm;
+	for(size_t i {0}; i != NumBuiltins; ++i) {
+		if(!Builtins[i].m_Symbol)
+			continue;
+
+		libm[res->m_JIT->mangleAndIntern(Builtins[i].m_Symbol)] = JITEvaluatedSymbol(
+			pointerToJITTargetAddress(Builtins[i].m_Address), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+	}
+
+	if(auto err = runtime.define(absoluteSymbols(std::move(libm))))
+		return err;
+
+	if(VectorizeMath) {
+		auto libmvec = DynamicLibrarySearchGenerator::Load("libmvec.so.1",
+				res->getDataLayout().getGlobalPrefix());
+		if(!libmvec)
+			return libmvec.takeError();
+
+		runtime.addGenerator(std::move(*libmvec));
+	}
+
+	res->m_JIT->getMainJITDylib().addToLinkOrder(runtime);
+
+	if(_fallback) {
+		res->m_JIT->getMainJITDylib().addGenerator(std::make_unique<FallbackGenerator>(
+			std::move(_fallback), res->getDataLayout().getGlobalPrefix()));
+	}
+
+	return res;
+}
+
+const DataLayout & ModKJIT::getDataLayout() const {
+	return m_JIT->getDataLayout();
+}
+
+const Triple & ModKJIT::getTargetTriple() const {
+	return m_JIT->getTargetTriple();
+}
+
+ResourceTrackerSP ModKJIT::createResourceTracker() {
+	return m_JIT->getMainJITDylib().createResourceTracker();
+}
+
+Error ModKJIT::addModule(ThreadSafeModule _module, ResourceTrackerSP _tracker) {
+	if(!_tracker)
+		_tracker = m_JIT->getMainJITDylib().getDefaultResourceTracker();
+
+	return m_JIT->addIRModule(_tracker, std::move(_module));
+}
+
+Expected<void *> ModKJIT::lookup(StringRef _name) {
+	auto sym = m_JIT->lookup(_name);
+	if(!sym)
+		return sym.takeError();
+
+	return reinterpret_cast<void *>(static_cast<uintptr_t>(sym->getAddress()));
+}
+
+Expected<TargetMachine *> ModKJIT::getThreadTargetMachine() {
+	// there's only ever the one ModKJIT, so one slot per thread will do
+	static thread_local std::unique_ptr<TargetMachine> target;
+
+	if(!target) {
+		JITTargetMachineBuilder builder = *m_TargetBuilder;
+
+		auto tm = builder.createTargetMachine();
+		if(!tm)
+			return tm.takeError();
+
+		target = std::move(*tm);
+	}
+
+	return target.get();
+}
+
+Expected<std::unique_ptr<MemoryBuffer>> ModKJIT::emitObject(Module & _module) {
+	auto target = getThreadTargetMachine();
+	if(!target)
+		return target.takeError();
+
+	if(_module.getDataLayout().isDefault())
+		_module.setDataLayout(getDataLayout());
+
+	if(_module.getTargetTriple().empty())
+		_module.setTargetTriple(getTargetTriple().str());
+
+	SimpleCompiler compiler {**target};
+	return compiler(_module);
+}
+
+Error ModKJIT::addObject(std::unique_ptr<MemoryBuffer> _object) {
+	return m_JIT->addObjectFile(std::move(_object));
+}
+
+Error ModKJIT::defineAbsolute(StringRef _name, void * _address) {
+	SymbolMap symbol;
+	symbol[m_JIT->mangleAndIntern(_name)] = JITEvaluatedSymbol(
+		pointerToJITTargetAddress(_address), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+
+	return m_Runtime->define(absoluteSymbols(std::move(symbol)));
+}
+
+// where a stub's first call lands if its version can't be compiled,
+// there's no caller left to hand an error to at that point
+static void StubResolutionFailed() {
+	fprintf(stderr, "> Fatal: couldn't compile a function on its first call\n");
+	abort();
+}
+
+Error ModKJIT::enableRedefinition() {
+	if(m_Versions)
+		return Error::success();
+
+	ExecutionSession & es = m_JIT->getExecutionSession();
+
+	auto call_through = createLocalLazyCallThroughManager(getTargetTriple(), es,
+			pointerToJITTargetAddress(&StubResolutionFailed));
+	if(!call_through)
+		return call_through.takeError();
+
+	auto stubs_builder = createLocalIndirectStubsManagerBuilder(getTargetTriple());
+	if(!stubs_builder)
+		return make_error<StringError>("no indirect stubs for " + getTargetTriple().str(),
+				inconvertibleErrorCode());
+
+	m_CallThrough = std::move(*call_through);
+	m_Stubs = stubs_builder();
+
+	// versions call each other through the stubs, like everyone else
+	JITDylib & versions = es.createBareJITDylib("modk.versions");
+	versions.addToLinkOrder(m_JIT->getMainJITDylib());
+	versions.addToLinkOrder(*m_Runtime);
+	m_Versions = &versions;
+
+	return Error::success();
+}
+
+ResourceTrackerSP ModKJIT::createVersionTracker() {
+	return m_Versions->createResourceTracker();
+}
+
+Error ModKJIT::defineStub(StringRef _name, StringRef _impl) {
+	{
+		std::lock_guard<std::mutex> lock {m_StubbedMutex};
+		if(!m_Stubbed.insert(_name.str()).second)
+			return Error::success();
+	}
+
+	SymbolAliasMap alias;
+	alias[m_JIT->mangleAndIntern(_name)] = SymbolAliasMapEntry(m_JIT->mangleAndIntern(_impl),
+			JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+
+	return m_JIT->getMainJITDylib().define(lazyReexports(*m_CallThrough, *m_Stubs, *m_Versions,
+				std::move(alias)));
+}
+
+Error ModKJIT::addVersion(ThreadSafeModule _module, StringRef _name, StringRef _impl,
+		ResourceTrackerSP _tracker) {
+
+	if(auto err = m_JIT->addIRModule(_tracker, std::move(_module)))
+		return err;
+
+	return defineStub(_name, _impl);
+}
+
+Error ModKJIT::addVersionObject(std::unique_ptr<MemoryBuffer> _object, StringRef _name,
+		StringRef _impl, ResourceTrackerSP _tracker) {
+
+	if(auto err = m_JIT->addObjectFile(_tracker, std::move(_object)))
+		return err;
+
+	return defineStub(_name, _impl);
+}
+
+Error ModKJIT::swapVersion(StringRef _name, StringRef _impl) {
+	auto impl = m_JIT->lookup(*m_Versions, _impl);
+	if(!impl)
+		return impl.takeError();
+
+	// the stub itself only exists once something has looked it up
+	auto stub = m_JIT->lookup(_name);
+	if(!stub)
+		return stub.takeError();
+
+	return m_Stubs->updatePointer(*m_JIT->mangleAndIntern(_name), impl->getAddress());
+}
+
+void OptimizeModule(Module & _module, TargetMachine * _tm) {
+	LoopAnalysisManager lam;
+	FunctionAnalysisManager fam;
+	CGSCCAnalysisManager cgam;
+	ModuleAnalysisManager mam;
+
+	// has to be registered ahead of the defaults or they win
+	const Triple triple = _tm ? _tm->getTargetTriple() : Triple(_module.getTargetTriple());
+
+	TargetLibraryInfoImpl tlii {triple};
+	if(VectorizeMath && triple.getArch() == Triple::x86_64)
+		tlii.addVectorizableFunctionsFromVecLib(TargetLibraryInfoImpl::LIBMVEC_X86);
+
+	fam.registerPass([&tlii] { return TargetLibraryAnalysis(tlii); });
+
+	PassBuilder pb {_tm};
+	pb.registerModuleAnalyses(mam);
+	pb.registerCGSCCAnalyses(cgam);
+	pb.registerFunctionAnalyses(fam);
+	pb.registerLoopAnalyses(lam);
+	pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+	if(!FastCompile) {
+		ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(OptimizationLevel::O2);
+		if(SplitColdCode)
+			mpm.addPass(HotColdSplittingPass());
+
+		mpm.run(_module, mam);
+
+		// @cold functions have their prefix from codegen, this catches
+		// the regions the splitter outlined
+		for(Function & f : _module) {
+			if(!f.isDeclaration() && f.hasFnAttribute(Attribute::Cold) && !f.getSectionPrefix())
+				f.setSectionPrefix("unlikely");
+		}
+
+		return;
+	}
+
+	// the memo wrappers are the only thing that spills to the stack,
+	// everything else is already straight line SSA from the builder
+	FunctionPassManager fpm;
+	fpm.addPass(PromotePass());
+	fpm.addPass(EarlyCSEPass());
+	fpm.addPass(InstCombinePass());
+	fpm.addPass(SimplifyCFGPass());
+
+	ModulePassManager mpm;
+	mpm.addPass(createModuleToFunctionPassAdaptor(std::move(fpm)));
+	mpm.run(_module, mam);
+}
+
+#pragma endregion
+
+#pragma region OBJECT_TARGET
+
+static std::once_flag ObjectTargetOnce;
+static std::unique_ptr<JITTargetMachineBuilder> ObjectTargetBuilder;
+static std::string ObjectTargetError {};
+
+// the host's builder with the JIT's options, apart from relocations
+static Error InitializeObjectTarget() {
+	std::call_once(ObjectTargetOnce, [] {
+		InitializeNativeTarget();
+		InitializeNativeTargetAsmPrinter();
+
+		auto jtmb = JITTargetMachineBuilder::detectHost();
+		if(!jtmb) {
+			ObjectTargetError = toString(jtmb.takeError());
+			return;
+		}
+
+		jtmb->setRelocationModel(Reloc::PIC_);
+
+		if(FastCompile) {
+			jtmb->setCodeGenOptLevel(CodeGenOpt::None);
+			jtmb->getOptions().EnableFastISel = true;
+		}
+
+		ObjectTargetBuilder = std::make_unique<JITTargetMachineBuilder>(std::move(*jtmb));
+	});
+
+	if(!ObjectTargetBuilder)
+		return make_error<StringError>(ObjectTargetError, inconvertibleErrorCode());
+
+	return Error::success();
+}
+
+Expected<TargetMachine *> GetObjectTargetMachine() {
+	static thread_local std::unique_ptr<TargetMachine> target;
+
+	if(!target) {
+		if(auto err = InitializeObjectTarget())
+			return err;
+
+		JITTargetMachineBuilder builder = *ObjectTargetBuilder;
+
+		auto tm = builder.createTargetMachine();
+		if(!tm)
+			return tm.takeError();
+
+		target = std::move(*tm);
+	}
+
+	return target.get();
+}
+
+Error PrepareObjectModule(Module & _module) {
+	auto target = GetObjectTargetMachine();
+	if(!target)
+		return target.takeError();
+
+	_module.setDataLayout((*target)->createDataLayout());
+	_module.setTargetTriple((*target)->getTargetTriple().str());
+
+	return Error::success();
+}
+
+Expected<std::unique_ptr<MemoryBuffer>> EmitObjectFile(Module & _module) {
+	auto target = GetObjectTargetMachine();
+	if(!target)
+		return target.takeError();
+
+	SimpleCompiler compiler {**target};
+	return compiler(_module);
+}
+
+#pragma endregion
+
+#pragma region EXTERN_SYMBOLS
+
+static std::mutex RegisteredSymbolsMutex;
+static std::map<std::string, void *> RegisteredSymbols;
+
+void * FindExternSymbol(const std::string & _name) {
+	{
+		std::lock_guard<std::mutex> lock {RegisteredSymbolsMutex};
+		if(auto it = RegisteredSymbols.find(_name); it != RegisteredSymbols.end())
+			return it->second;
+	}
+
+	// a null path loads the process itself, only the first call does anything
+	static const bool process_loaded = !sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+	if(!process_loaded)
+		return nullptr;
+
+	return sys::DynamicLibrary::SearchForAddressOfSymbol(_name);
+}
+
+bool LoadExternLibrary(const char * _path, std::string & _error) {
+	return !sys::DynamicLibrary::LoadLibraryPermanently(_path, &_error);
+}
+
+extern "C" void modk_register_symbol(const char * _name, void * _address) {
+	std::lock_guard<std::mutex> lock {RegisteredSymbolsMutex};
+	RegisteredSymbols[_name] = _address;
+}
+
+#pragma endregion
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+class CodeMemoryPool;
+
+// Thin wrapper around ORC's LLJIT, this is where hot bytecode
+// functions get promoted to and what top level expressions the
+// interpreter can't handle are compiled with
+class ModKJIT {
+	std::unique_ptr<llvm::orc::LLJIT> m_JIT;
+
+	// copied for every thread that needs a TargetMachine, see
+	// getThreadTargetMachine
+	std::unique_ptr<llvm::orc::JITTargetMachineBuilder> m_TargetBuilder;
+
+	// libm and extern symbols, linked behind the main JITDylib
+	llvm::orc::JITDylib * m_Runtime {nullptr};
+
+	// backs every linked object unless PooledCodeMemory is off, the
+	// memory managers share it so it outlives the JIT if it has to
+	std::shared_ptr<CodeMemoryPool> m_CodeMemory;
+
+	// with redefinition on, function bodies live in m_Versions under
+	// versioned names and the main JITDylib only has a stub for each
+	std::unique_ptr<llvm::orc::LazyCallThroughManager> m_CallThrough;
+	std::unique_ptr<llvm::orc::IndirectStubsManager> m_Stubs;
+	llvm::orc::JITDylib * m_Versions {nullptr};
+
+	// names that got their stub, versions can be added from inside a
+	// lookup on the compile threads
+	std::mutex m_StubbedMutex;
+	std::set<std::string> m_Stubbed;
+
+	llvm::Error defineStub(llvm::StringRef _name, llvm::StringRef _impl);
+
+	public:
+		// called when a module being linked references a function that
+		// hasn't been handed to the JIT yet (i.e. it's still only
+		// interpreted), the callback is expected to compile and add it
+		using SymbolFallback = std::function<bool (llvm::StringRef)>;
+
+		// with _compile_threads > 0 optimization and code emission run
+		// on that many threads in the background, otherwise in whichever
+		// thread triggered the lookup
+		static llvm::Expected<std::unique_ptr<ModKJIT>> Create(SymbolFallback _fallback,
+				const unsigned _compile_threads = 0);
+
+		const llvm::DataLayout & getDataLayout() const;
+		const llvm::Triple & getTargetTriple() const;
+
+		llvm::orc::ResourceTrackerSP createResourceTracker();
+
+		llvm::Error addModule(llvm::orc::ThreadSafeModule _module,
+				llvm::orc::ResourceTrackerSP _tracker = nullptr);
+
+		llvm::Expected<void *> lookup(llvm::StringRef _name);
+
+		// a TargetMachine for the calling thread only, built on first use
+		llvm::Expected<llvm::TargetMachine *> getThreadTargetMachine();
+
+		// for code that was optimized and emitted outside the JIT (i.e.
+		// by compile jobs), emitObject compiles _module as is and the
+		// result goes straight to the linking layer with addObject
+		llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> emitObject(llvm::Module & _module);
+		llvm::Error addObject(std::unique_ptr<llvm::MemoryBuffer> _object);
+
+		// binds _name to a host address for every module linked after,
+		// this is how extern declarations reach native code
+		llvm::Error defineAbsolute(llvm::StringRef _name, void * _address);
+
+		// nullptr when objects get LLVM's SectionMemoryManager
+		const CodeMemoryPool * codeMemory() const { return m_CodeMemory.get(); }
+
+		// Redefinition. Once enabled every function is added as a version
+		// whose symbol is _impl, while callers link against a stub named
+		// _name that jumps to the current version. The first version
+		// added for a name creates its stub, which resolves that version
+		// lazily on its first call. Later ones take over with swapVersion
+		llvm::Error enableRedefinition();
+		bool redefinable() const { return m_Versions != nullptr; }
+
+		llvm::orc::ResourceTrackerSP createVersionTracker();
+
+		llvm::Error addVersion(llvm::orc::ThreadSafeModule _module, llvm::StringRef _name,
+				llvm::StringRef _impl, llvm::orc::ResourceTrackerSP _tracker);
+		llvm::Error addVersionObject(std::unique_ptr<llvm::MemoryBuffer> _object, llvm::StringRef _name,
+				llvm::StringRef _impl, llvm::orc::ResourceTrackerSP _tracker);
+
+		// compiles _impl if it isn't yet and points _name's stub at it,
+		// a single pointer store so calls already in the old version
+		// finish there and every call after lands in the new one. Not
+		// safe against a stub's first call resolving at the same time,
+		// so only call it from the thread that runs ModK code
+		llvm::Error swapVersion(llvm::StringRef _name, llvm::StringRef _impl);
+};
+
+// where an extern declaration's symbol lives: whatever was registered
+// under _name, otherwise the host process and every library loaded
+// with LoadExternLibrary. nullptr if it's nowhere
+void * FindExternSymbol(const std::string & _name);
+
+// makes a shared library's symbols visible to FindExternSymbol, on
+// failure _error says why
+bool LoadExternLibrary(const char * _path, std::string & _error);
+
+// the registered symbol table, for hosts embedding ModK and for
+// libraries to call from their constructors when loaded. Entries take
+// precedence over process symbols of the same name
+extern "C" void modk_register_symbol(const char * _name, void * _address);
+
+// trades code quality for latency: a handful of cheap function passes
+// instead of O2, and no optimization in the backend so instruction
+// selection goes through FastISel. Has to be set before Create()
+extern bool FastCompile;
+
+// lets the vectorizers use glibc's libmvec SIMD variants of the math
+// builtins (x86-64 only). The JIT loads libmvec itself, objects from
+// --emit-obj need linking with -lmvec. Has to be set before Create()
+extern bool VectorizeMath;
+
+// links JIT'd objects into the slabs of a CodeMemoryPool instead of
+// giving each its own pages. Has to be set before Create()
+extern bool PooledCodeMemory;
+
+// asks for transparent huge pages behind the pool's slabs, so code
+// spread over many small functions takes fewer iTLB entries. The dual
+// mapped slabs are shared memory and only get them if the kernel's
+// transparent_hugepage/shmem_enabled allows. Has to be set before Create()
+extern bool HugePages;
+
+// outlines the cold parts of functions (the paths that end up calling
+// a @cold function) into functions of their own in .text.unlikely, so
+// they're laid out away from the hot code
+extern bool SplitColdCode;
+
+// runs the default O2 pipeline over _module (or the cut down one with
+// FastCompile), tuned for _tm if given
+void OptimizeModule(llvm::Module & _module, llvm::TargetMachine * _tm);
+
+// Ahead of time target, what --emit-obj compiles for. The objects end
+// up linked into PIE executables and shared libraries, so unlike the
+// JIT's code they're position independent. None of this needs a
+// ModKJIT, the host target is set up on first use
+
+// a TargetMachine for the calling thread only, built on first use
+llvm::Expected<llvm::TargetMachine *> GetObjectTargetMachine();
+
+// stamps _module with the host's data layout and triple
+llvm::Error PrepareObjectModule(llvm::Module & _module);
+
+// compiles _module as is into an object file's contents
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> EmitObjectFile(llvm::Module & _module);
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <tuple>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Memory.h"
+
+#include "jitmem.hpp"
+
+using namespace llvm;
+
+#pragma region CODE_MEMORY_POOL
+
+// a transparent huge page, slabs are a multiple of it and aligned to it
+static constexpr size_t SlabSize = 2 * 1024 * 1024;
+
+// rel32 reaches 2 GB either way, so within this anything can reference
+// anything. Only address space, past it slabs go wherever mmap puts them
+static constexpr size_t RegionSize = size_t {1} << 30;
+
+struct CodeMemoryPool::Slab {
+	uint8_t * m_Local {nullptr};
+	uint8_t * m_Target {nullptr};
+	size_t m_Size {0};
+	Kind m_Kind {Kind::Code};
+	bool m_Dual {false};
+	bool m_InRegion {false};
+
+	// bump allocated, m_Used goes back to 0 once nothing in it is live
+	size_t m_Used {0};
+	size_t m_Live {0};
+	size_t m_LiveBlocks {0};
+};
+
+static bool IsCode(const CodeMemoryPool::Kind _kind) {
+	return _kind == CodeMemoryPool::Kind::HotCode || _kind == CodeMemoryPool::Kind::Code
+		|| _kind == CodeMemoryPool::Kind::ColdCode;
+}
+
+static size_t PageSize() {
+	static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return page;
+}
+
+// _size bytes at a SlabSize aligned address, so the kernel is free to
+// back them with huge pages. _fd -1 maps anonymous memory
+static uint8_t * MapAligned(const size_t _size, const int _prot, const int _fd) {
+	const size_t span = _size + SlabSize;
+
+	void * reserved = mmap(nullptr, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(reserved == MAP_FAILED)
+		return nullptr;
+
+	uint8_t * base = static_cast<uint8_t *>(reserved);
+	uint8_t * aligned = reinterpret_cast<uint8_t *>(alignTo(reinterpret_cast<uintptr_t>(base), SlabSize));
+
+	const int flags = _fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED : MAP_SHARED | MAP_FIXED;
+	if(mmap(aligned, _size, _prot, flags, _fd, 0) == MAP_FAILED) {
+		munmap(base, span);
+		return nullptr;
+	}
+
+	if(aligned != base)
+		munmap(base, aligned - base);
+
+	munmap(aligned + _size, base + span - (aligned + _size));
+	return aligned;
+}
+
+// _size bytes of _fd (or anonymous memory) at _addr, which has to lie
+// in address space we already own
+static bool MapAt(uint8_t * _addr, const size_t _size, const int _prot, const int _fd) {
+	const int flags = _fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED : MAP_SHARED | MAP_FIXED;
+	return mmap(_addr, _size, _prot, flags, _fd, 0) != MAP_FAILED;
+}
+
+CodeMemoryPool::CodeMemoryPool(const bool _huge_pages) : m_HugePages {_huge_pages} {
+	m_Region = MapAligned(RegionSize, PROT_NONE, -1);
+}
+
+CodeMemoryPool::~CodeMemoryPool() {
+	for(auto & slabs : m_Slabs)
+		for(auto & slab : slabs)
+			unmapSlab(*slab);
+
+	if(m_Region)
+		munmap(m_Region, RegionSize);
+}
+
+uint8_t * CodeMemoryPool::takeRange(const size_t _size) {
+	for(auto it = m_FreeRanges.begin(); it != m_FreeRanges.end(); ++it) {
+		if(it->second < _size)
+			continue;
+
+		uint8_t * base = it->first;
+		it->first += _size;
+		it->second -= _size;
+
+		if(!it->second)
+			m_FreeRanges.erase(it);
+
+		return base;
+	}
+
+	if(!m_Region || m_RegionUsed + _size > RegionSize)
+		return nullptr;
+
+	uint8_t * base = m_Region + m_RegionUsed;
+	m_RegionUsed += _size;
+	return base;
+}
+
+void CodeMemoryPool::returnRange(uint8_t * _base, const size_t _size) {
+	// back to a reservation, so nothing else in the process lands there
+	mmap(_base, _size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+	m_FreeRanges.emplace_back(_base, _size);
+}
+
+CodeMemoryPool::Slab * CodeMemoryPool::mapSlab(const Kind _kind, const size_t _size) {
+	auto slab = std::make_unique<Slab>();
+	slab->m_Kind = _kind;
+	slab->m_Size = _size;
+
+	uint8_t * range = takeRange(_size);
+
+	if(m_DualMapped && _kind != Kind::ReadWrite) {
+		const int fd = memfd_create("modk-jit", MFD_CLOEXEC);
+		const int prot = IsCode(_kind) ? PROT_READ | PROT_EXEC : PROT_READ;
+
+		if(fd >= 0 && ftruncate(fd, static_cast<off_t>(_size)) == 0) {
+			slab->m_Local = MapAligned(_size, PROT_READ | PROT_WRITE, fd);
+
+			if(slab->m_Local && range)
+				slab->m_Target = MapAt(range, _size, prot, fd) ? range : nullptr;
+			else if(slab->m_Local)
+				slab->m_Target = MapAligned(_size, prot, fd);
+
+			if(slab->m_Local && !slab->m_Target) {
+				munmap(slab->m_Local, _size);
+				slab->m_Local = nullptr;
+			}
+		}
+
+		// the mappings keep the memory alive on their own
+		if(fd >= 0)
+			close(fd);
+
+		// i.e. a policy against executable shared mappings, from here
+		// on slabs are plain memory and blocks get protected instead
+		if(slab->m_Local)
+			slab->m_Dual = true;
+		else
+			m_DualMapped = false;
+	}
+
+	if(!slab->m_Local) {
+		if(range)
+			slab->m_Local = MapAt(range, _size, PROT_READ | PROT_WRITE, -1) ? range : nullptr;
+		else
+			slab->m_Local = MapAligned(_size, PROT_READ | PROT_WRITE, -1);
+
+		slab->m_Target = slab->m_Local;
+	}
+
+	slab->m_InRegion = range && slab->m_Target == range;
+
+	if(!slab->m_Local) {
+		if(range)
+			returnRange(range, _size);
+
+		return nullptr;
+	}
+
+	if(m_HugePages) {
+		madvise(slab->m_Local, _size, MADV_HUGEPAGE);
+		if(slab->m_Dual)
+			madvise(slab->m_Target, _size, MADV_HUGEPAGE);
+	}
+
+	++m_Stats.m_Slabs;
+	m_Stats.m_Mapped += _size;
+
+	Slab * raw = slab.get();
+	m_Slabs[static_cast<size_t>(_kind)].push_back(std::move(slab));
+	return raw;
+}
+
+void CodeMemoryPool::unmapSlab(Slab & _slab) {
+	if(_slab.m_Dual)
+		munmap(_slab.m_Local, _slab.m_Size);
+
+	if(_slab.m_InRegion)
+		returnRange(_slab.m_Target, _slab.m_Size);
+	else
+		munmap(_slab.m_Target, _slab.m_Size);
+
+	--m_Stats.m_Slabs;
+	m_Stats.m_Mapped -= _slab.m_Size;
+}
+
+CodeMemoryPool::Block CodeMemoryPool::allocate(const Kind _kind, const size_t _size, const size_t _align) {
+	const size_t kind = static_cast<size_t>(_kind);
+	std::lock_guard<std::mutex> lock {m_Mutex};
+
+	Block block {};
+
+	auto carve = [&](Slab & _slab) {
+		size_t align = std::max<size_t>(_align, 1);
+		size_t size = std::max<size_t>(_size, 1);
+
+		// without a second mapping permissions are per page, so code and
+		// read-only blocks can't share one with anything else
+		if(!_slab.m_Dual && _kind != Kind::ReadWrite) {
+			align = std::max(align, PageSize());
+			size = alignTo(size, PageSize());
+		}
+
+		const size_t offset = alignTo(_slab.m_Used, align);
+		if(offset + size > _slab.m_Size)
+			return false;
+
+		_slab.m_Used = offset + size;
+		_slab.m_Live += size;
+		++_slab.m_LiveBlocks;
+
+		block = Block {_slab.m_Local + offset, _slab.m_Target + offset, size, _kind, &_slab};
+		return true;
+	};
+
+	Slab * slab = m_Current[kind];
+
+	if(!slab || !carve(*slab)) {
+		slab = nullptr;
+
+		// a slab that emptied out before mapping another one
+		for(auto & candidate : m_Slabs[kind]) {
+			if(candidate->m_LiveBlocks == 0 && carve(*candidate)) {
+				slab = candidate.get();
+				break;
+			}
+		}
+
+		if(!slab) {
+			slab = mapSlab(_kind, alignTo(_size + _align + PageSize(), SlabSize));
+			if(!slab || !carve(*slab))
+				return Block {};
+		}
+
+		m_Current[kind] = slab;
+	}
+
+	++m_Stats.m_Blocks;
+	m_Stats.m_Live += block.m_Size;
+	m_Stats.m_LiveByKind[kind] += block.m_Size;
+
+	return block;
+}
+
+void CodeMemoryPool::release(const Block & _block) {
+	if(!_block.m_Local)
+		return;
+
+	const size_t kind = static_cast<size_t>(_block.m_Kind);
+	Slab & slab = *static_cast<Slab *>(_block.m_Slab);
+
+	std::lock_guard<std::mutex> lock {m_Mutex};
+
+	// back to writable so the pages can be handed out again
+	if(!slab.m_Dual && _block.m_Kind != Kind::ReadWrite) {
+		mprotect(_block.m_Local, _block.m_Size, PROT_READ | PROT_WRITE);
+		++m_Stats.m_Protects;
+	}
+
+	slab.m_Live -= _block.m_Size;
+	m_Stats.m_Live -= _block.m_Size;
+	m_Stats.m_LiveByKind[kind] -= _block.m_Size;
+
+	if(--slab.m_LiveBlocks)
+		return;
+
+	slab.m_Used = 0;
+
+	if(&slab == m_Current[kind])
+		return;
+
+	// one empty slab per kind stays mapped for the next burst of code
+	auto & slabs = m_Slabs[kind];
+	const bool spare = std::any_of(slabs.begin(), slabs.end(), [&](const auto & _other) {
+		return _other.get() != &slab && _other.get() != m_Current[kind] && _other->m_LiveBlocks == 0;
+	});
+
+	if(!spare)
+		return;
+
+	unmapSlab(slab);
+	slabs.erase(std::find_if(slabs.begin(), slabs.end(), [&](const auto & _other) {
+		return _other.get() == &slab;
+	}));
+}
+
+bool CodeMemoryPool::protect(const Block & _block) {
+	if(_block.m_Local != _block.m_Target || _block.m_Kind == Kind::ReadWrite)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> lock {m_Mutex};
+		++m_Stats.m_Protects;
+	}
+
+	const int prot = IsCode(_block.m_Kind) ? PROT_READ | PROT_EXEC : PROT_READ;
+	return mprotect(_block.m_Local, _block.m_Size, prot) == 0;
+}
+
+CodeMemoryPool::Kind CodeMemoryPool::codeKind(StringRef _name) {
+	if(_name.startswith(".text.hot"))
+		return Kind::HotCode;
+
+	if(_name.startswith(".text.unlikely") || _name.startswith(".text.split"))
+		return Kind::ColdCode;
+
+	return Kind::Code;
+}
+
+CodeMemoryPool::Stats CodeMemoryPool::stats() const {
+	std::lock_guard<std::mutex> lock {m_Mutex};
+
+	Stats stats = m_Stats;
+	stats.m_DualMapped = m_DualMapped;
+	return stats;
+}
+
+#pragma endregion
+
+#pragma region POOLED_MEMORY_MANAGER
+
+PooledMemoryManager::PooledMemoryManager(std::shared_ptr<CodeMemoryPool> _pool)
+	: m_Pool {std::move(_pool)}, m_Load {std::make_unique<LoadState>()} {}
+
+PooledMemoryManager::~PooledMemoryManager() {
+	for(const CodeMemoryPool::Block & block : m_Blocks)
+		m_Pool->release(block);
+}
+
+void PooledMemoryManager::reserveAllocationSpace(uintptr_t, uint32_t, uintptr_t _ro,
+		uint32_t _ro_align, uintptr_t _rw, uint32_t _rw_align) {
+
+	// code isn't reserved, where it goes depends on its section
+	const std::tuple<CodeMemoryPool::Kind, uintptr_t, uint32_t> data[] = {
+		{CodeMemoryPool::Kind::ReadOnly, _ro, _ro_align},
+		{CodeMemoryPool::Kind::ReadWrite, _rw, _rw_align}
+	};
+
+	for(const auto & [kind, size, align] : data) {
+		if(!size)
+			continue;
+
+		CodeMemoryPool::Block block = m_Pool->allocate(kind, size, align);
+		if(!block.m_Local)
+			continue;
+
+		m_Blocks.push_back(block);
+		m_Load->m_Reserved[static_cast<size_t>(kind)] = Reservation {block, 0};
+	}
+}
+
+uint8_t * PooledMemoryManager::allocate(const CodeMemoryPool::Kind _kind, const uintptr_t _size,
+		const unsigned _align) {
+
+	const size_t align = std::max(1u, _align);
+	Reservation & reserved = m_Load->m_Reserved[static_cast<size_t>(_kind)];
+
+	uint8_t * local {nullptr};
+	uint8_t * target {nullptr};
+
+	if(reserved.m_Block.m_Local) {
+		const size_t offset = alignTo(reserved.m_Used, align);
+
+		if(offset + _size <= reserved.m_Block.m_Size) {
+			reserved.m_Used = offset + _size;
+			local = reserved.m_Block.m_Local + offset;
+			target = reserved.m_Block.m_Target + offset;
+		}
+	}
+
+	// RuntimeDyld doesn't count everything (the GOT for one) in what it
+	// reserves, whatever doesn't fit gets a block of its own
+	if(!local) {
+		CodeMemoryPool::Block block = m_Pool->allocate(_kind, _size, align);
+		if(!block.m_Local)
+			return nullptr;
+
+		m_Blocks.push_back(block);
+		local = block.m_Local;
+		target = block.m_Target;
+	}
+
+	if(local != target)
+		m_Load->m_Remapped.emplace_back(local, target);
+
+	if(IsCode(_kind))
+		m_Load->m_CodeSections.emplace_back(target, _size);
+
+	return local;
+}
+
+uint8_t * PooledMemoryManager::allocateCodeSection(uintptr_t _size, unsigned _align, unsigned,
+		StringRef _name) {
+	return allocate(CodeMemoryPool::codeKind(_name), _size, _align);
+}
+
+uint8_t * PooledMemoryManager::allocateDataSection(uintptr_t _size, unsigned _align, unsigned,
+		StringRef, bool _read_only) {
+	return allocate(_read_only ? CodeMemoryPool::Kind::ReadOnly : CodeMemoryPool::Kind::ReadWrite,
+			_size, _align);
+}
+
+// called before relocations are resolved, so everything gets linked
+// against the addresses it'll run at while being written through the
+// writable mapping
+void PooledMemoryManager::notifyObjectLoaded(RuntimeDyld & _dyld, const object::ObjectFile &) {
+	for(const auto & [local, target] : m_Load->m_Remapped)
+		_dyld.mapSectionAddress(local, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(target)));
+}
+
+void PooledMemoryManager::registerEHFrames(uint8_t *, uint64_t _load_addr, size_t _size) {
+	// the unwinder has to find the frames where the code runs
+	uint8_t * frames = reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(_load_addr));
+
+	registerEHFramesInProcess(frames, _size);
+	EHFrames.push_back({frames, _size});
+}
+
+bool PooledMemoryManager::finalizeMemory(std::string * _error) {
+	for(const CodeMemoryPool::Block & block : m_Blocks) {
+		if(!m_Pool->protect(block)) {
+			if(_error)
+				*_error = "couldn't protect JIT memory";
+
+			return true;
+		}
+	}
+
+	for(const auto & [code, size] : m_Load->m_CodeSections)
+		sys::Memory::InvalidateInstructionCache(code, size);
+
+	// there's a manager per object, so what's left of it adds up
+	m_Load.reset();
+	m_Blocks.shrink_to_fit();
+
+	return false;
+}
+
+#pragma endregion
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+
+// Where the JIT puts the code and data of the objects it links. LLVM's
+// SectionMemoryManager maps fresh pages for every object and mprotects
+// each section on its own, so with one module per top level expression
+// the code ends up scattered a page per function. The pool packs every
+// object into a few large slabs instead, one set per kind of memory
+//
+// code is split three ways by the section it comes from, so functions
+// marked hot (.text.hot) share slabs with each other and cold ones
+// (.text.unlikely, .text.split) stay out of their way, whenever each
+// got compiled. Everything is carved out of one reserved range, which
+// keeps any two blocks within rel32 reach of each other
+//
+// where the kernel lets us, code and read-only slabs are dual mapped: a
+// memfd is mapped once writable for RuntimeDyld to load into and once
+// executable (or read-only) for the code to run from, so nothing ever
+// has to change permissions and sections can share pages. Otherwise
+// blocks are rounded to pages and protected when the object finalizes
+class CodeMemoryPool {
+	public:
+		enum class Kind : uint8_t {
+			HotCode,
+			Code,
+			ColdCode,
+			ReadOnly,
+			ReadWrite,
+
+			Count
+		};
+
+		// m_Local is where a block is written, m_Target where it's used
+		// from, the same address unless its slab is dual mapped
+		struct Block {
+			uint8_t * m_Local {nullptr};
+			uint8_t * m_Target {nullptr};
+			size_t m_Size {0};
+			Kind m_Kind {Kind::Code};
+			void * m_Slab {nullptr};
+		};
+
+		struct Stats {
+			size_t m_Slabs {0};
+			size_t m_Mapped {0};
+			size_t m_Live {0};
+			size_t m_LiveByKind[static_cast<size_t>(Kind::Count)] {};
+			uint64_t m_Blocks {0};
+			uint64_t m_Protects {0};
+			bool m_DualMapped {false};
+		};
+
+	private:
+		struct Slab;
+
+		mutable std::mutex m_Mutex;
+		std::vector<std::unique_ptr<Slab>> m_Slabs[static_cast<size_t>(Kind::Count)];
+		Slab * m_Current[static_cast<size_t>(Kind::Count)] {};
+
+		bool m_HugePages {false};
+		bool m_DualMapped {true};
+
+		// where slabs are mapped at (their target side), ranges of
+		// unmapped slabs are handed out again first
+		uint8_t * m_Region {nullptr};
+		size_t m_RegionUsed {0};
+		std::vector<std::pair<uint8_t *, size_t>> m_FreeRanges;
+
+		Stats m_Stats {};
+
+		uint8_t * takeRange(const size_t _size);
+		void returnRange(uint8_t * _base, const size_t _size);
+
+		Slab * mapSlab(const Kind _kind, const size_t _size);
+		void unmapSlab(Slab & _slab);
+
+	public:
+		explicit CodeMemoryPool(const bool _huge_pages);
+		~CodeMemoryPool();
+
+		CodeMemoryPool(const CodeMemoryPool &) = delete;
+		CodeMemoryPool & operator=(const CodeMemoryPool &) = delete;
+
+		// _size bytes aligned to _align, m_Local is nullptr if the
+		// kernel wouldn't give us the memory
+		Block allocate(const Kind _kind, const size_t _size, const size_t _align);
+
+		// a slab that's left without live blocks is reused from the
+		// start, and unmapped if the pool already has a spare one
+		void release(const Block & _block);
+
+		// the permissions a block of _kind runs with, a no-op for dual
+		// mapped blocks. Returns false if mprotect failed
+		bool protect(const Block & _block);
+
+		bool dualMapped() const { return m_DualMapped; }
+		Stats stats() const;
+
+		// which code slabs a section called _name belongs in
+		static Kind codeKind(llvm::StringRef _name);
+};
+
+// RuntimeDyld's view of the pool, there's one per linked object. The
+// object's data sections come out of a single reservation per kind,
+// code is placed section by section according to its hotness, and
+// everything goes back to the pool when the layer drops the manager,
+// i.e. when the object's resource tracker is removed
+class PooledMemoryManager : public llvm::RTDyldMemoryManager {
+	struct Reservation {
+		CodeMemoryPool::Block m_Block {};
+		size_t m_Used {0};
+	};
+
+	// only needed until the object is finalized, the manager itself
+	// stays as long as the object does so this goes early
+	struct LoadState {
+		Reservation m_Reserved[static_cast<size_t>(CodeMemoryPool::Kind::Count)];
+
+		// sections whose local and target addresses differ
+		std::vector<std::pair<uint8_t *, uint8_t *>> m_Remapped;
+		std::vector<std::pair<uint8_t *, size_t>> m_CodeSections;
+	};
+
+	std::shared_ptr<CodeMemoryPool> m_Pool;
+	std::vector<CodeMemoryPool::Block> m_Blocks;
+	std::unique_ptr<LoadState> m_Load;
+
+	uint8_t * allocate(const CodeMemoryPool::Kind _kind, const uintptr_t _size, const unsigned _align);
+
+	public:
+		explicit PooledMemoryManager(std::shared_ptr<CodeMemoryPool> _pool);
+		~PooledMemoryManager() override;
+
+		uint8_t * allocateCodeSection(uintptr_t _size, unsigned _align, unsigned _id,
+				llvm::StringRef _name) override;
+		uint8_t * allocateDataSection(uintptr_t _size, unsigned _align, unsigned _id,
+				llvm::StringRef _name, bool _read_only) override;
+
+		bool needsToReserveAllocationSpace() override { return true; }
+		void reserveAllocationSpace(uintptr_t _code, uint32_t _code_align, uintptr_t _ro,
+				uint32_t _ro_align, uintptr_t _rw, uint32_t _rw_align) override;
+
+		void notifyObjectLoaded(llvm::RuntimeDyld & _dyld, const llvm::object::ObjectFile &) override;
+		void registerEHFrames(uint8_t * _addr, uint64_t _load_addr, size_t _size) override;
+		bool finalizeMemory(std::string * _error) override;
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+// lexer returns tokens from uchar size 0-255 if the token is unknown
+// otherwise it will return a known token from this enum. It's left
+// unscoped so tokens and plain characters compare as the ints they
+// are, but is always written qualified i.e. Token::Token_func
+enum Token : int {
+	// Flag Tokens
+	Token_EOF = -1,
+	
+	// Command Tokens
+	Token_func = -2,
+	
+	// Integer Types
+	Token_i32 = -3,
+	Token_u32 = -4,
+	
+	// Character Types
+	Token_char = -5,
+	Token_uchar = -6,
+	
+	// Strings
+	Token_str = -7,
+	
+	// Floating-Point types
+	Token_f32 = -8,
+	Token_uf32 = -9,
+
+	// Primary Tokens
+	TokenIdentifier = -10,
+	TokenNumber = -11,
+
+	// Boolean type
+	Token_bool = -12,
+
+	// Control Flow
+	Token_if = -13,
+	Token_then = -14,
+	Token_else = -15,
+
+	// Two character operators, the single character
+	// ones are returned as themselves
+	Token_le = -16,		// <=
+	Token_ge = -17,		// >=
+	Token_eq = -18,		// ==
+	Token_ne = -19,		// !=
+	Token_and = -20,	// &&
+	Token_or = -21,		// ||
+
+	// Foreign function declarations
+	Token_extern = -22,
+};
+
+// filled when an identifiable keyword or expression is reach
+// (per thread, the pipelined driver lexes and parses on different ones)
+static thread_local std::string IdentifierStr;
+
+// filled when a numeric value or literal is reached
+static thread_local double NumberValue;
+
+// a token along with whatever GetToken left in IdentifierStr or
+// NumberValue for it, so tokens can be lexed ahead of the parser
+struct LexedToken {
+	int m_Kind {};
+	double m_Number {};
+	std::string m_Identifier {};
+};
+
+// where the parser pulls tokens from when it isn't calling GetToken
+// itself, next() has to restore IdentifierStr/NumberValue as well
+class TokenSource {
+	public:
+		virtual ~TokenSource() = default;
+		virtual int next() = 0;
+};
+
+static LexedToken CaptureToken(const int _kind) {
+	LexedToken tok {_kind};
+
+	// the lexer overwrites IdentifierStr on the next identifier anyway
+	if(_kind == Token::TokenIdentifier)
+		tok.m_Identifier = std::move(IdentifierStr);
+	else if(_kind == Token::TokenNumber)
+		tok.m_Number = NumberValue;
+
+	return tok;
+}
+
+static int RestoreToken(const LexedToken & _tok) {
+	if(_tok.m_Kind == Token::TokenIdentifier)
+		IdentifierStr = _tok.m_Identifier;
+	else if(_tok.m_Kind == Token::TokenNumber)
+		NumberValue = _tok.m_Number;
+
+	return _tok.m_Kind;
+}
+
+// for tokens nobody else is going to read again
+static int RestoreToken(LexedToken && _tok) {
+	if(_tok.m_Kind == Token::TokenIdentifier)
+		IdentifierStr = std::move(_tok.m_Identifier);
+	else if(_tok.m_Kind == Token::TokenNumber)
+		NumberValue = _tok.m_Number;
+
+	return _tok.m_Kind;
+}
+
+// lexes a single token, characters come from _next() and
+// LastCharacter carries the one character of lookahead between calls,
+// shared by GetToken and the buffer lexer so both agree on the language
+template<typename NextCharacter>
+static int LexToken(int & LastCharacter, NextCharacter && _next) {
+
+	// skip whitespace found
+	while(isspace(LastCharacter))
+		LastCharacter = _next();
+
+	if(isalpha(LastCharacter)) {
+		IdentifierStr = LastCharacter;
+		
+		while(isalnum((LastCharacter = _next())))
+			IdentifierStr += LastCharacter;
+	
+		// At the moment - this just simply returns numeric values
+		// associated with each token in the enum - however as the
+		// language grows we may need more functionality between types
+		//
+		// for now this looks pretty basic - because it is, and i will
+		// most likely leave this until other behaviour is required
+		static const std::pair<const char *, Token> Keywords[] {
+			{"func", Token::Token_func},
+			{"extern", Token::Token_extern},
+
+			/* --- Signed & unSigned integer types --- */
+			{"i32", Token::Token_i32},
+			{"u32", Token::Token_u32},
+
+			/* --- Signed & unSigned character types --- */
+			{"char", Token::Token_char},
+			{"uchar", Token::Token_uchar},
+
+			/* --- String type --- */
+			{"str", Token::Token_str},
+
+			/* --- Signed & unSigned floating-point types --- */
+			{"f32", Token::Token_f32},
+			{"uf32", Token::Token_uf32},
+
+			/* --- Boolean type --- */
+			{"bool", Token::Token_bool},
+
+			/* --- Control flow --- */
+			{"if", Token::Token_if},
+			{"then", Token::Token_then},
+			{"else", Token::Token_else},
+		};
+
+		for(const auto & [keyword, token] : Keywords)
+			if(IdentifierStr == keyword)
+				return token;
+
+		return Token::TokenIdentifier;
+	}
+
+	// Handles number literals [0-9] inclusively
+	if(isdigit(LastCharacter) || LastCharacter == '.') {
+		std::string NumberStr;
+		
+		// the do-while here is fundamentally flawed and
+		// its understandable why - 1.234 is parsed correctly
+		// however in cases where you wnat to use a separator 
+		// for digits - this just isnt yet possible
+		//
+		// IMO until theres a need for something like 
+		// 1.23.45.67 or 1_000_000 Ill leave this how it is
+		do {
+			NumberStr += LastCharacter;
+			LastCharacter = _next();
+			
+		} while(isdigit(LastCharacter) || LastCharacter == '.');
+		
+		NumberValue = strtod(NumberStr.c_str(), 0);
+
+		return Token::TokenNumber;
+	}
+
+	// we'll go with what the LLVM tutorial recommends for now
+	// though, I'd rather use // and /* for single and 
+	// multi-lined comments, so this will definitely change
+	if(LastCharacter == '#') {
+
+		do
+			LastCharacter = _next();
+		while(LastCharacter != EOF && LastCharacter != '\n' 
+				&& LastCharacter != '\r');
+
+		if(LastCharacter != EOF)
+			return LexToken(LastCharacter, _next);
+	}
+
+	if(LastCharacter == EOF)
+		return Token::Token_EOF;
+
+	int ThisCharacter = LastCharacter;
+       	LastCharacter = _next();
+
+	// a second character can only ever extend one of these, so one
+	// character of lookahead is all it takes
+	int Combined = 0;
+
+	if(LastCharacter == '=') {
+		switch(ThisCharacter) {
+			case '<': Combined = Token::Token_le; break;
+			case '>': Combined = Token::Token_ge; break;
+			case '=': Combined = Token::Token_eq; break;
+			case '!': Combined = Token::Token_ne; break;
+		}
+	} else if(LastCharacter == ThisCharacter) {
+		if(ThisCharacter == '&')
+			Combined = Token::Token_and;
+		else if(ThisCharacter == '|')
+			Combined = Token::Token_or;
+	}
+
+	if(Combined) {
+		LastCharacter = _next();
+		return Combined;
+	}
+
+	return ThisCharacter;	
+}
+
+// lexes the token files and returns the next token in
+// the standard input range
+static int GetToken() {
+	static int LastCharacter = ' ';
+
+	return LexToken(LastCharacter, getchar);
+}
+
+// lexes [_begin, _end) in one go, the result always ends in Token_EOF
+static std::vector<LexedToken> LexBuffer(const char * _begin, const char * _end) {
+	std::vector<LexedToken> tokens;
+
+	// roughly one token per 4 bytes on the generated files
+	tokens.reserve((_end - _begin) / 4 + 1);
+
+	int last = ' ';
+	auto next = [&]() -> int {
+		return _begin == _end ? EOF : static_cast<unsigned char>(*_begin++);
+	};
+
+	while(true) {
+		const int tok = LexToken(last, next);
+		tokens.push_back(CaptureToken(tok));
+
+		if(tok == Token::Token_EOF)
+			return tokens;
+	}
+}
+
+// Lexes _source on up to _threads threads. Normally a chunk would have
+// to guess whether it starts inside a comment or string, and be lexed
+// again when the guess was wrong. Here the only state that carries
+// across characters is a # comment, which always ends at a newline,
+// and no token spans one. So each chunk is cut just after a newline,
+// "not in a comment" is always the right guess, and stitching is only
+// dropping every chunk's Token_EOF bar the last
+static std::vector<LexedToken> LexParallel(const std::string & _source, unsigned _threads) {
+	const char * data = _source.data();
+	const size_t size = _source.size();
+
+	// below this a chunk costs more to hand out than to lex
+	constexpr size_t MinChunkSize = 1 << 20;
+
+	_threads = std::max<size_t>(1, std::min<size_t>(_threads, size / MinChunkSize));
+	if(_threads == 1)
+		return LexBuffer(data, data + size);
+
+	std::vector<size_t> cuts {0};
+	for(unsigned i {1}; i < _threads; ++i) {
+		size_t cut = std::max(cuts.back(), size * i / _threads);
+
+		while(cut > 0 && cut < size && data[cut - 1] != '\n')
+			++cut;
+
+		cuts.push_back(cut);
+	}
+	cuts.push_back(size);
+
+	std::vector<std::vector<LexedToken>> chunks(_threads);
+	std::vector<std::thread> workers;
+
+	for(unsigned i {0}; i < _threads; ++i) {
+		workers.emplace_back([&, i] {
+			chunks[i] = LexBuffer(data + cuts[i], data + cuts[i + 1]);
+		});
+	}
+
+	for(auto & worker : workers)
+		worker.join();
+
+	size_t total {0};
+	for(const auto & chunk : chunks)
+		total += chunk.size();
+
+	std::vector<LexedToken> tokens;
+	tokens.reserve(total);
+
+	for(auto & chunk : chunks) {
+		chunk.pop_back();
+		std::move(chunk.begin(), chunk.end(), std::back_inserter(tokens));
+	}
+
+	tokens.push_back(LexedToken {Token::Token_EOF});
+	return tokens;
+}
+
+// slurps the whole of _file, for the lexers that want a buffer
+static std::string ReadSource(FILE * _file) {
+	std::string source;
+	char buffer[1 << 16];
+
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), _file)) > 0)
+		source.append(buffer, n);
+
+	return source;
+}
+
+// hands out tokens that were all lexed up front, running off the end
+// of the range (or into a Token_EOF) gives Token_EOF from then on
+class VectorTokenSource : public TokenSource {
+	const LexedToken * m_Pos;
+	const LexedToken * m_End;
+
+	public:
+		VectorTokenSource(const LexedToken * _begin, const LexedToken * _end)
+			: m_Pos {_begin}, m_End {_end} {}
+
+		explicit VectorTokenSource(const std::vector<LexedToken> & _tokens)
+			: VectorTokenSource(_tokens.data(), _tokens.data() + _tokens.size()) {}
+
+		virtual int next() override {
+			if(m_Pos == m_End || m_Pos->m_Kind == Token::Token_EOF)
+				return Token::Token_EOF;
+
+			return RestoreToken(*m_Pos++);
+		}
+};
@@ -0,0 +1,187 @@
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "memo.hpp"
+
+size_t MemoCacheCapacity {4096};
+
+#pragma region MEMO_CACHE
+
+// splitmix64 finalizer, plenty for spreading argument bits over sets
+static uint64_t MixBits(uint64_t _x) {
+	_x ^= _x >> 30;
+	_x *= 0xbf58476d1ce4e5b9ULL;
+	_x ^= _x >> 27;
+	_x *= 0x94d049bb133111ebULL;
+	return _x ^ (_x >> 31);
+}
+
+MemoCache::MemoCache(const std::string & _name, const unsigned _argc, const size_t _capacity)
+	: m_Name {_name}, m_Argc {_argc}, m_Stride {_argc + 1u} {
+
+	size_t sets {1};
+	while(sets * Ways < _capacity)
+		sets <<= 1;
+
+	m_SetMask = sets - 1;
+	m_Sets = std::make_unique<Set[]>(sets);
+	m_Slots = std::make_unique<std::atomic<uint64_t>[]>(sets * Ways * m_Stride);
+}
+
+bool MemoCache::lookup(const double * _args, double & _result) {
+	uint64_t key[MaxMemoArgs];
+	uint64_t hash {m_Argc};
+
+	for(unsigned i {0}; i != m_Argc; ++i) {
+		std::memcpy(&key[i], &_args[i], sizeof(double));
+		hash = MixBits(hash ^ key[i]);
+	}
+
+	const size_t set_idx = hash & m_SetMask;
+	Set & set = m_Sets[set_idx];
+	const std::atomic<uint64_t> * slots = &m_Slots[set_idx * Ways * m_Stride];
+
+	while(true) {
+		uint32_t seq = set.m_Sequence.load(std::memory_order_acquire);
+
+		// a store is in flight, not worth waiting for
+		if(seq & 1)
+			break;
+
+		const unsigned filled = set.m_Filled.load(std::memory_order_relaxed);
+		bool found {false};
+		uint64_t bits {};
+
+		for(unsigned way {0}; way != filled && !found; ++way) {
+			const std::atomic<uint64_t> * entry = slots + way * m_Stride;
+
+			found = true;
+			for(unsigned i {0}; i != m_Argc && found; ++i)
+				found = entry[i].load(std::memory_order_relaxed) == key[i];
+
+			if(found)
+				bits = entry[m_Argc].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(set.m_Sequence.load(std::memory_order_relaxed) != seq)
+			continue;
+
+		if(!found)
+			break;
+
+		std::memcpy(&_result, &bits, sizeof(double));
+		m_Hits.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	m_Misses.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void MemoCache::store(const double * _args, const double _result) {
+	uint64_t key[MaxMemoArgs];
+	uint64_t hash {m_Argc};
+
+	for(unsigned i {0}; i != m_Argc; ++i) {
+		std::memcpy(&key[i], &_args[i], sizeof(double));
+		hash = MixBits(hash ^ key[i]);
+	}
+
+	const size_t set_idx = hash & m_SetMask;
+	Set & set = m_Sets[set_idx];
+	std::atomic<uint64_t> * slots = &m_Slots[set_idx * Ways * m_Stride];
+
+	// another thread is filling this set, it's only a cache
+	uint32_t seq = set.m_Sequence.load(std::memory_order_relaxed);
+	if((seq & 1) || !set.m_Sequence.compare_exchange_strong(seq, seq + 1,
+				std::memory_order_acquire))
+		return;
+
+	unsigned way = set.m_Filled.load(std::memory_order_relaxed);
+	if(way < Ways) {
+		set.m_Filled.store(way + 1, std::memory_order_relaxed);
+	} else {
+		way = set.m_Next;
+		set.m_Next = (set.m_Next + 1) % Ways;
+		m_Evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64_t> * entry = slots + way * m_Stride;
+	for(unsigned i {0}; i != m_Argc; ++i)
+		entry[i].store(key[i], std::memory_order_relaxed);
+
+	uint64_t bits;
+	std::memcpy(&bits, &_result, sizeof(double));
+	entry[m_Argc].store(bits, std::memory_order_relaxed);
+
+	set.m_Sequence.store(seq + 2, std::memory_order_release);
+}
+
+void MemoCache::clear() {
+	for(size_t set_idx {0}; set_idx <= m_SetMask; ++set_idx) {
+		Set & set = m_Sets[set_idx];
+
+		// unlike a store this can't just give up on a busy set
+		uint32_t seq = set.m_Sequence.load(std::memory_order_relaxed);
+		while((seq & 1) || !set.m_Sequence.compare_exchange_weak(seq, seq + 1,
+					std::memory_order_acquire))
+			seq = set.m_Sequence.load(std::memory_order_relaxed) & ~1u;
+
+		set.m_Filled.store(0, std::memory_order_relaxed);
+		set.m_Next = 0;
+
+		set.m_Sequence.store(seq + 2, std::memory_order_release);
+	}
+}
+
+#pragma endregion
+
+#pragma region MEMO_REGISTRY
+
+static std::mutex MemoMutex;
+static std::map<std::string, std::unique_ptr<MemoCache>> MemoCaches;
+
+MemoCache * GetMemoCache(const std::string & _name, const unsigned _argc) {
+	if(_argc > MaxMemoArgs)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock {MemoMutex};
+
+	// keyed on the arity too, caches are never freed since compiled
+	// wrappers hold on to their address for good
+	auto & cache = MemoCaches[_name + "/" + std::to_string(_argc)];
+	if(!cache)
+		cache = std::make_unique<MemoCache>(_name, _argc, MemoCacheCapacity);
+
+	return cache.get();
+}
+
+void PrintMemoStats(FILE * _out) {
+	std::lock_guard<std::mutex> lock {MemoMutex};
+
+	for(const auto & [key, cache] : MemoCaches) {
+		const uint64_t hits = cache->getHits();
+		const uint64_t total = hits + cache->getMisses();
+
+		if(!total)
+			continue;
+
+		fprintf(_out, "> memo %s: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions\n",
+			cache->getName().c_str(), static_cast<unsigned long long>(hits),
+			static_cast<unsigned long long>(total - hits), 100.0 * hits / total,
+			static_cast<unsigned long long>(cache->getEvictions()));
+	}
+}
+
+extern "C" int modk_memo_lookup(MemoCache * _cache, const double * _args, double * _result) {
+	return _cache->lookup(_args, *_result);
+}
+
+extern "C" void modk_memo_store(MemoCache * _cache, const double * _args, double _result) {
+	_cache->store(_args, _result);
+}
+
+#pragma endregion
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// functions with more arguments than this are never memoized
+constexpr unsigned MaxMemoArgs = 6;
+
+// default number of entries per cache, rounded up to whole sets
+extern size_t MemoCacheCapacity;
+
+// Bounded, set associative result cache for one @memo function.
+// Keys are the raw argument bits, so -0.0/0.0 and NaN payloads are
+// distinct keys. Every set is guarded by a seqlock: lookups never
+// block and simply report a miss while a store is in flight, stores
+// that lose the race to another writer are dropped, either way the
+// caller just computes the value itself
+class MemoCache {
+	static constexpr unsigned Ways = 4;
+
+	struct alignas(64) Set {
+		std::atomic<uint32_t> m_Sequence {0};
+		std::atomic<uint8_t> m_Filled {0};
+		uint8_t m_Next {0};
+	};
+
+	std::string m_Name {};
+	unsigned m_Argc {0};
+	size_t m_Stride {0};
+	size_t m_SetMask {0};
+
+	std::unique_ptr<Set[]> m_Sets;
+	std::unique_ptr<std::atomic<uint64_t>[]> m_Slots;
+
+	std::atomic<uint64_t> m_Hits {0};
+	std::atomic<uint64_t> m_Misses {0};
+	std::atomic<uint64_t> m_Evictions {0};
+
+	public:
+		MemoCache(const std::string & _name, const unsigned _argc, const size_t _capacity);
+
+		bool lookup(const double * _args, double & _result);
+		void store(const double * _args, const double _result);
+
+		// drops every entry, i.e. once the function has been redefined
+		void clear();
+
+		const std::string & getName() const { return m_Name; }
+		unsigned getArgc() const { return m_Argc; }
+
+		uint64_t getHits() const { return m_Hits.load(std::memory_order_relaxed); }
+		uint64_t getMisses() const { return m_Misses.load(std::memory_order_relaxed); }
+		uint64_t getEvictions() const { return m_Evictions.load(std::memory_order_relaxed); }
+};
+
+// one cache per function name, shared by the interpreter and the
+// native wrapper so a function keeps its results across tier-up
+MemoCache * GetMemoCache(const std::string & _name, const unsigned _argc);
+
+// hit rate of every cache that saw at least one call
+void PrintMemoStats(FILE * _out);
+
+// entry points the generated memo wrappers call, their addresses are
+// baked straight into the IR so the JIT never has to resolve them
+extern "C" int modk_memo_lookup(MemoCache * _cache, const double * _args, double * _result);
+extern "C" void modk_memo_store(MemoCache * _cache, const double * _args, double _result);
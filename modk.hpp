@@ -1,20 +1,54 @@
 #include <vector>
+#include <atomic>
 #include <algorithm>
 #include <string>
 #include <memory>
 #include <map>
+#include <set>
 #include <cstdlib>
 #include <cctype>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "builtins.hpp"
+#include "bytecode.hpp"
+#include "effects.hpp"
+#include "exprcache.hpp"
+#include "jit.hpp"
+#include "jitmem.hpp"
+#include "memo.hpp"
+#include "scheduler.hpp"
+#include "server.hpp"
+#include "spsc.hpp"
@@ -1,5 +1,11 @@
+#include "modk.hpp"
+#include "lexer.hpp"
+
+using namespace llvm;
+using namespace llvm::orc;
+
 // Base class for expression nodes
-enum class Types {
+enum class Types : uint8_t {
 	I32,
 	U32,
 	F32,
@@ -7,9 +13,128 @@ enum class Types {
 	STR,
 	CHAR,
 	UCHAR,
+	BOOL,
 	NONE,
 };
 
+// Argument type lists are interned, nodes only keep the index of
+// theirs. Programs use a handful of distinct signatures, so this
+// saves a vector (and its heap block) per call, prototype and
+// definition. Id 0 is always the empty list, which isn't stored so
+// the table starts out empty and has nothing to build before main
+using SignatureId = uint32_t;
+
+class SignatureTable {
+	std::mutex m_Lock;
+	std::map<std::vector<Types>, SignatureId> m_Index;
+	std::vector<const std::vector<Types> *> m_Signatures;
+
+	public:
+		// nodes are built on the parser threads, hence the lock
+		SignatureId intern(const std::vector<Types> & _types) {
+			if(_types.empty())
+				return 0;
+
+			std::lock_guard<std::mutex> lock {m_Lock};
+
+			auto [it, added] = m_Index.try_emplace(_types, static_cast<SignatureId>(m_Signatures.size() + 1));
+			if(added)
+				m_Signatures.push_back(&it->first);
+
+			return it->second;
+		}
+
+		const std::vector<Types> & get(const SignatureId _id) {
+			static const std::vector<Types> empty;
+			if(!_id)
+				return empty;
+
+			std::lock_guard<std::mutex> lock {m_Lock};
+			return *m_Signatures[_id - 1];
+		}
+};
+
+static SignatureTable Signatures;
+
+// function attributes, written as @name between func and the
+// function's name i.e func @memo fib(n) ... top level expressions
+// take them in front of the expression, where @specialize opts the
+// expression out of literal hoisting
+enum class FunctionAttribute : uint8_t {
+	Memo,
+	Specialize,
+	FastMath,
+	Strict,
+	Hot,
+	Cold,
+	Inline,
+	NoInline,
+};
+
+// the name tables are plain arrays rather than maps, a map would have
+// to be built by a static constructor on every start
+template<typename T, size_t N>
+static const T * FindName(const std::pair<const char *, T> (& _table)[N], const std::string & _name) {
+	for(const auto & [name, value] : _table)
+		if(_name == name)
+			return &value;
+
+	return nullptr;
+}
+
+static constexpr std::pair<const char *, FunctionAttribute> FunctionAttributeNames[] {
+	{"memo", FunctionAttribute::Memo},
+	{"specialize", FunctionAttribute::Specialize},
+	{"fastmath", FunctionAttribute::FastMath},
+	{"strict", FunctionAttribute::Strict},
+	{"hot", FunctionAttribute::Hot},
+	{"cold", FunctionAttribute::Cold},
+	{"inline", FunctionAttribute::Inline},
+	{"noinline", FunctionAttribute::NoInline},
+};
+
+// pairs that can't both be on one function
+static const std::pair<FunctionAttribute, FunctionAttribute> ConflictingAttributes[] {
+	{FunctionAttribute::FastMath, FunctionAttribute::Strict},
+	{FunctionAttribute::Hot, FunctionAttribute::Cold},
+	{FunctionAttribute::Inline, FunctionAttribute::NoInline},
+};
+
+// how freely floating point may be rewritten by the JIT. The module
+// wide default comes from --fp-contract / --fast-math, functions can
+// override it with @fastmath / @strict and single expressions with
+// @fastmath <expr> / @strict <expr>. The interpreter always evaluates
+// strictly, only native code ever sees the difference
+enum class FPMode : uint8_t {
+	Strict,		// IEEE, every operation rounded as written
+	Contract,	// a * b + c may become one fused multiply-add
+	Fast,		// reassociation, reciprocals, no NaNs or infinities ...
+};
+
+// written @name in front of an operand, see ParseAnnotatedExpr
+enum class ExpressionAnnotation : uint8_t {
+	FastMath,
+	Strict,
+	Likely,
+	Unlikely,
+};
+
+static constexpr std::pair<const char *, ExpressionAnnotation> ExpressionAnnotationNames[] {
+	{"fastmath", ExpressionAnnotation::FastMath},
+	{"strict", ExpressionAnnotation::Strict},
+	{"likely", ExpressionAnnotation::Likely},
+	{"unlikely", ExpressionAnnotation::Unlikely},
+};
+
+// which way an if's condition is expected to go
+enum class BranchHint : uint8_t {
+	None,
+	Likely,
+	Unlikely,
+};
+
+static FPMode DefaultFPMode {FPMode::Strict};
+
 #pragma region AST_NODES
 
 class ExpressionAST {
@@ -17,6 +142,26 @@ class ExpressionAST {
 	public:
 		virtual ~ExpressionAST() = default;
 		virtual Value * codegen() const = 0;
+
+		// the node's value as an i1 for branches and selects, anything
+		// that isn't a comparison or logical operator is true unless
+		// it's 0.0 (so NaN is true, like the interpreter)
+		virtual Value * codegenCondition() const;
+
+		// cheap and can't fail, so fine to evaluate unconditionally
+		// (i.e. both arms of an if can become a select)
+		virtual bool isTrivial() const { return false; }
+
+		// set by @likely / @unlikely, read by whatever branches on the node
+		virtual BranchHint branchHint() const { return BranchHint::None; }
+
+		// lowers the node into the interpreter's bytecode and returns
+		// the register holding its value, -1 if the node can't be
+		// expressed there (the caller falls back to the JIT)
+		virtual int emit(BytecodeCompiler &) const { return -1; }
+
+		// writes the node's canonical encoding for the expression cache
+		virtual void fingerprint(AstFingerprint & _fp) const { _fp.invalidate(); }
 };
 
 // Expression class for number literals like 1, 2 or 1.23
@@ -26,6 +171,9 @@ class NumberLiteralAST : public ExpressionAST {
 	public:
 		NumberLiteralAST(double _value) : m_Value {_value} {}
 		virtual Value * codegen() const override;
+		virtual bool isTrivial() const override { return true; }
+		virtual int emit(BytecodeCompiler & _bc) const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
 };
 
 // Expression class for string literals like "Hello, World!"
@@ -33,40 +181,199 @@ class StringLiteralAST : public ExpressionAST {
 	std::string m_Literal {};
 
 	public:
-		StringLiteralAST(std::string & _literal) : m_Literal {_literal} {}
+		explicit StringLiteralAST(std::string _literal) : m_Literal {std::move(_literal)} {}
 		virtual Value * codegen() const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
+};
+
+// codegen state is per thread, every thread builds into a module
+// of its own (see CompileAllForJIT)
+static thread_local std::unique_ptr<LLVMContext> TheContext;
+static thread_local std::unique_ptr<IRBuilder<>> Builder;
+static thread_local std::unique_ptr<Module> TheModule;
+static thread_local std::map<std::string, Value *> NamedValues;
+
+std::unique_ptr<ExpressionAST> LogError(const char* str);
+
+// mode of whatever is being generated right now, SetFPMode keeps the
+// builder's fast math flags in step with it
+static thread_local FPMode CurrentFPMode {FPMode::Strict};
+
+// set while generating a literal hoisting kernel, number literals
+// are then loaded from here in visiting order instead of being
+// baked in as constants
+static thread_local Value * HoistedLiterals {nullptr};
+static thread_local unsigned NextHoistedLiteral {0};
+
+// off by default, exact literals are what most code wants
+static bool HoistLiterals {false};
+
+// compile definitions natively as they come in rather than letting
+// the interpreter tier them up, only takes effect on batched input
+static bool EagerJIT {false};
+
+// print per job timings after every batch of compile jobs
+static bool ReportJobs {false};
+
+// bounded memory mode for endless input, see FlushStream
+static bool Streaming {false};
+
+// functions can be redefined while the process runs, see RedefineFunction
+static bool HotReload {false};
+
+// set by --emit-obj, objects are written to <prefix>.<n>.o instead of
+// anything being run
+static std::string ObjectOutput {};
+
+// every definition seen so far, kept around so the tiering code can
+// still codegen a function long after it was parsed
+class FunctionAST;
+static std::map<std::string, std::unique_ptr<FunctionAST>> FunctionDefinitions;
+
+// what's left of a definition once streaming mode has compiled it and
+// thrown the rest away, enough for later modules to declare it. The
+// argument names go too, a declaration has no use for them
+struct RetiredFunction {
+	uint32_t m_NumArgs {0};
+	uint8_t m_Attributes {0};
 };
 
-static std::unique_ptr<LLVMContext> TheContext;
-static std::unique_ptr<IRBuilder> Builder;
-static std::unique_ptr<Module> TheModule;
-static std::unique_ptr<std::string, Value *> NamedValues;
+static std::map<std::string, RetiredFunction> RetiredFunctions;
+
+// extern declarations, calls to these go straight to the host symbol
+class PrototypeAST;
+static std::map<std::string, std::unique_ptr<PrototypeAST>> ExternFunctions;
+
+// the ones the JIT can resolve, an extern declared while emitting an
+// object file is left to the linker until something runs it
+static std::set<std::string> BoundExterns;
+
+// fresh context and module for each batch of code handed to the JIT
+static void InitializeModule() {
+	// whatever was left of the last one has to go before its context
+	TheModule.reset();
+	TheContext = std::make_unique<LLVMContext>();
+	TheContext->setDiscardValueNames(FastCompile);
+	TheModule = std::make_unique<Module>("ModK JIT", *TheContext);
+	Builder = std::make_unique<IRBuilder<>>(*TheContext);
+}
+
+static void SetFPMode(const FPMode _mode) {
+	FastMathFlags flags;
+
+	if(_mode == FPMode::Fast)
+		flags.setFast();
+	else if(_mode == FPMode::Contract)
+		flags.setAllowContract();
+
+	CurrentFPMode = _mode;
+	Builder->setFastMathFlags(flags);
+}
 
 Value * LogErrorV(const char* Str) {
 	LogError(Str);
 	return nullptr;
 }
 
+// FastCompile only keeps the verifier in debug builds, it's a whole
+// extra walk over the IR for every line typed into the REPL
+static void VerifyGenerated(Function & _fn) {
+#ifdef NDEBUG
+	if(FastCompile)
+		return;
+#endif
+
+	verifyFunction(_fn, &errs());
+}
+
 // Expression class for referencing variables with a type
 // such as <type> <name>;
 class VariableExpressionAST : public ExpressionAST {
 	std::string m_Name {};
-	std::unique_ptr<Types> m_Type;
+	Types m_Type {Types::NONE};
 	
 	public:
-		VariableExpressionAST(const std::unique_ptr<Types> & _type, const std::string & _name)
-			: m_Type {std::move(_type)}, m_Name {_name} {} 
+		VariableExpressionAST(const Types _type, std::string _name)
+			: m_Name {std::move(_name)}, m_Type {_type} {}
+
+		virtual Value * codegen() const override;
+		virtual bool isTrivial() const override { return true; }
+		virtual int emit(BytecodeCompiler & _bc) const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
 };
 
-// Expression class for binary operators +, -, /, * etc
+// Expression class for binary operators +, -, /, * etc, the
+// operator is its token so the two character ones fit too
 class BinaryExpressionAST : public ExpressionAST {
-	char m_Operator {};
+	int m_Operator {};
 	std::unique_ptr<ExpressionAST> LHS, RHS;
 
 	public:
-		BinaryExpressionAST(const char _op, std::unique_ptr<ExpressionAST> _rhs,
-				std::unique_ptr<ExpressionAST> _lhs)
-			: m_Operator {_op}, LHS {std::move(_lhs)}, RHS {_rhs} {}
+		BinaryExpressionAST(const int _op, std::unique_ptr<ExpressionAST> _lhs,
+				std::unique_ptr<ExpressionAST> _rhs)
+			: m_Operator {_op}, LHS {std::move(_lhs)}, RHS {std::move(_rhs)} {}
+
+		// comparisons and && / || are BOOL typed, they only become
+		// 1.0 / 0.0 where they're used as a number
+		bool isComparison() const;
+		bool isLogical() const;
+
+		virtual Value * codegen() const override;
+		virtual Value * codegenCondition() const override;
+		virtual int emit(BytecodeCompiler & _bc) const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
+};
+
+// Expression class for if <cond> then <expr> else <expr>
+class IfExpressionAST : public ExpressionAST {
+	std::unique_ptr<ExpressionAST> m_Cond, m_Then, m_Else;
+
+	public:
+		IfExpressionAST(std::unique_ptr<ExpressionAST> _cond, std::unique_ptr<ExpressionAST> _then,
+				std::unique_ptr<ExpressionAST> _else)
+			: m_Cond {std::move(_cond)}, m_Then {std::move(_then)}, m_Else {std::move(_else)} {}
+
+		virtual Value * codegen() const override;
+		virtual int emit(BytecodeCompiler & _bc) const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
+};
+
+// Expression class for @fastmath <expr> and @strict <expr>
+class FPModeExpressionAST : public ExpressionAST {
+	FPMode m_Mode {FPMode::Strict};
+	std::unique_ptr<ExpressionAST> m_Body;
+
+	public:
+		FPModeExpressionAST(const FPMode _mode, std::unique_ptr<ExpressionAST> _body)
+			: m_Mode {_mode}, m_Body {std::move(_body)} {}
+
+		virtual Value * codegen() const override;
+		virtual Value * codegenCondition() const override;
+		virtual bool isTrivial() const override { return m_Body->isTrivial(); }
+		virtual BranchHint branchHint() const override { return m_Body->branchHint(); }
+		virtual int emit(BytecodeCompiler & _bc) const override { return m_Body->emit(_bc); }
+		virtual void fingerprint(AstFingerprint & _fp) const override;
+};
+
+// Expression class for @likely <expr> and @unlikely <expr>, only has
+// an effect where the value is branched on (if conditions and the
+// left side of && / ||). The hint doesn't change what's computed, so
+// the interpreter looks straight through it, the fingerprint keeps it
+// since native code is laid out by it
+class BranchHintExpressionAST : public ExpressionAST {
+	BranchHint m_Hint {BranchHint::None};
+	std::unique_ptr<ExpressionAST> m_Body;
+
+	public:
+		BranchHintExpressionAST(const BranchHint _hint, std::unique_ptr<ExpressionAST> _body)
+			: m_Hint {_hint}, m_Body {std::move(_body)} {}
+
+		virtual Value * codegen() const override { return m_Body->codegen(); }
+		virtual Value * codegenCondition() const override { return m_Body->codegenCondition(); }
+		virtual bool isTrivial() const override { return m_Body->isTrivial(); }
+		virtual BranchHint branchHint() const override { return m_Hint; }
+		virtual int emit(BytecodeCompiler & _bc) const override { return m_Body->emit(_bc); }
+		virtual void fingerprint(AstFingerprint & _fp) const override;
 };
 
 // Expression class for function calls
@@ -74,15 +381,18 @@ class FuncCallAST : public ExpressionAST {
 	std::string m_Caller {};
 	std::vector<std::unique_ptr<ExpressionAST>> m_Args;
 	
-	std::vector<Types> m_ArgsTypes;
-	std::unique_ptr<Types> m_ReturnType;
+	SignatureId m_ArgTypes {0};
+	Types m_ReturnType {Types::NONE};
 
 	public:
-		FuncCallAST(const std::string & _caller, std::vector<std::unique_ptr<ExpressionAST>>
-				& _args, const std::unique_ptr<Types> _return_type, 
-					std::vector<Types> & _arg_types)
-			: m_Caller {_caller}, m_Args {std::move(_args)}, m_ReturnType {std::move(_return_type)},
-			  m_ArgTypes {_arg_types} {}
+		FuncCallAST(std::string _caller, std::vector<std::unique_ptr<ExpressionAST>> _args,
+				const Types _return_type = Types::NONE, const SignatureId _arg_types = 0)
+			: m_Caller {std::move(_caller)}, m_Args {std::move(_args)}, m_ArgTypes {_arg_types},
+			  m_ReturnType {_return_type} {}
+
+		virtual Value * codegen() const override;
+		virtual int emit(BytecodeCompiler & _bc) const override;
+		virtual void fingerprint(AstFingerprint & _fp) const override;
 };
 
 // Expression class for function prototypes i.e
@@ -91,37 +401,97 @@ class PrototypeAST : public ExpressionAST {
 	std::string m_Name {};
 	std::vector<std::string> m_Args;
 	
-	std::vector<Types> m_ArgTypes;
-	std::unique_ptr<Types> m_ReturnType;
+	SignatureId m_ArgTypes {0};
+	Types m_ReturnType {Types::NONE};
+
+	uint8_t m_Attributes {0};
+
+	// declared with extern, takes and returns the C types in the
+	// signature rather than doubles and has no ModK body
+	bool m_Extern {false};
 
 	public:
-		PrototypeAST(const std::string & _name, std::vector<std::string> _args,
-				std::unique_ptr<Types> _return_type, std::vector<Types> & _arg_types)
-			: m_Name {_name}, m_Args {_args}, m_ReturnType {std::move(_return_type)},
-			  m_ArgTypes {_arg_types}
+		// sink parameters, callers move in what they've built up
+		PrototypeAST(std::string _name, std::vector<std::string> _args,
+				const Types _return_type = Types::NONE, const SignatureId _arg_types = 0)
+			: m_Name {std::move(_name)}, m_Args {std::move(_args)}, m_ArgTypes {_arg_types},
+			  m_ReturnType {_return_type} {}
+
+		const std::vector<Types> & getArgTypes() const { return Signatures.get(m_ArgTypes); }
+		Types getReturnType() const { return m_ReturnType; }
+
+		const std::string & getName() const { return m_Name; }
+		const std::vector<std::string> & getArgs() const { return m_Args; }
+
+		void addAttribute(const FunctionAttribute _attr) {
+			m_Attributes |= 1u << static_cast<unsigned>(_attr);
+		}
+
+		void setAttributes(const uint8_t _attributes) { m_Attributes = _attributes; }
+
+		bool hasAttribute(const FunctionAttribute _attr) const {
+			return m_Attributes & (1u << static_cast<unsigned>(_attr));
+		}
+
+		uint8_t getAttributes() const { return m_Attributes; }
+
+		void markExtern() { m_Extern = true; }
+		bool isExtern() const { return m_Extern; }
+
+		Function * codegen() const;
 };
 
 // Expression class for function definitions 
 // (including the body)
 class FunctionAST : public ExpressionAST {
 	std::unique_ptr<PrototypeAST> m_Proto;
-	std::unique_ptr<ExpressionAST m_Body;
-	
-	std::vector<Types> m_ArgsTypes;
+	std::unique_ptr<ExpressionAST> m_Body;
+
+	// the argument types are the prototype's, no copy of them here
+	uint32_t m_NumLiterals {0};
+	bool m_HoistLiterals {false};
 
 	public:
-		FunctionAST(std::unique_ptr<PrototypeAST> _proto, std::unique_ptr<ExpressionAST> _body, 
-				std::vector<Types> & _arg_types)
-			: m_Proto {std::move(_proto)}, m_Body {std::move(_body)},
-	     			m_ArgTypes {_arg_types}	{}
+		FunctionAST(std::unique_ptr<PrototypeAST> _proto, std::unique_ptr<ExpressionAST> _body)
+			: m_Proto {std::move(_proto)}, m_Body {std::move(_body)} {}
+
+		const std::string & getName() const { return m_Proto->getName(); }
+		const PrototypeAST & getProto() const { return *m_Proto; }
+
+		Function * codegen() const;
+
+		// lowers the body into _fn, which the caller has either declared
+		// in _module (definitions) or owns itself (top level expressions)
+		bool lower(const BytecodeModule & _module, BytecodeFunction & _fn) const;
+
+		// turns the function into a kernel that takes its _count number
+		// literals through a pointer instead of baking them in, the
+		// values are bound per call (see AstFingerprint::literals)
+		void hoistLiterals(const uint32_t _count) {
+			m_HoistLiterals = true;
+			m_NumLiterals = _count;
+		}
+
+		bool hoistsLiterals() const { return m_HoistLiterals; }
+
+		// parameters are bound by position, so the function's own name
+		// and its parameter names don't show up in the encoding
+		void fingerprint(AstFingerprint & _fp) const;
 };
 
 #pragma endregion
 
 // Simple token buffer where CurrentToken is what
 // is being looked at and GetNextToken reads the other tokens
-static int CurrentToken;
+static thread_local int CurrentToken;
+
+// set when tokens were lexed ahead of time (i.e on another thread)
+static thread_local TokenSource * ActiveTokenSource {nullptr};
+
 static int GetNextToken() {
+	if(ActiveTokenSource)
+		return CurrentToken = ActiveTokenSource->next();
+
 	return CurrentToken = GetToken();
 }
 
@@ -138,20 +508,25 @@ std::unique_ptr<PrototypeAST> LogErrorProto(const char* str) {
 
 // for parsing number literal expressions
 static std::unique_ptr<ExpressionAST> ParseNumExpr(const double NumVal) {
-	auto res = std::make_unique<NumberExpressionAST> (NumVal);
+	auto res = std::make_unique<NumberLiteralAST> (NumVal);
 	GetNextToken();
 
-	return std::move(res);
+	return res;
 }
 
 // for parsing string literal expressions
-static std::unique_ptr<ExpressionAST> ParseStrExpr(const std::string & str) {
-	auto res = std::make_unique<StringExpressionAST> (str);
+[[maybe_unused]] static std::unique_ptr<ExpressionAST> ParseStrExpr(std::string str) {
+	auto res = std::make_unique<StringLiteralAST> (std::move(str));
 	GetNextToken();
 
-	return std::move(res);
+	return res;
 }
 
+static std::unique_ptr<ExpressionAST> ParsePrimary();
+static std::unique_ptr<ExpressionAST> ParseExpression();
+static std::unique_ptr<ExpressionAST> ParseBinaryOpRHS(const int ExprPrecedence,
+		std::unique_ptr<ExpressionAST> LHS);
+
 // parsing parent expressions such as ::= ( expr )
 static std::unique_ptr<ExpressionAST> ParseParentExpr() {
 	GetNextToken();
@@ -165,24 +540,95 @@ static std::unique_ptr<ExpressionAST> ParseParentExpr() {
 	return v;
 }
 
+// if ::= 'if' expr 'then' expr 'else' expr
+static std::unique_ptr<ExpressionAST> ParseIfExpr() {
+	GetNextToken();
+
+	auto cond = ParseExpression();
+	if(!cond)
+		return nullptr;
+
+	if(CurrentToken != Token::Token_then)
+		return LogError("> Expected 'then'");
+
+	GetNextToken();
+
+	auto then = ParseExpression();
+	if(!then)
+		return nullptr;
+
+	if(CurrentToken != Token::Token_else)
+		return LogError("> Expected 'else'");
+
+	GetNextToken();
+
+	auto otherwise = ParseExpression();
+	if(!otherwise)
+		return nullptr;
+
+	return std::make_unique<IfExpressionAST> (std::move(cond), std::move(then), std::move(otherwise));
+}
+
+// the operand after an annotation whose name has been read already
+static std::unique_ptr<ExpressionAST> ParseAnnotated(const ExpressionAnnotation _annotation) {
+	auto body = ParsePrimary();
+	if(!body)
+		return nullptr;
+
+	switch(_annotation) {
+		case ExpressionAnnotation::FastMath:
+			return std::make_unique<FPModeExpressionAST> (FPMode::Fast, std::move(body));
+
+		case ExpressionAnnotation::Strict:
+			return std::make_unique<FPModeExpressionAST> (FPMode::Strict, std::move(body));
+
+		case ExpressionAnnotation::Likely:
+			return std::make_unique<BranchHintExpressionAST> (BranchHint::Likely, std::move(body));
+
+		default:
+			return std::make_unique<BranchHintExpressionAST> (BranchHint::Unlikely, std::move(body));
+	}
+}
+
+// @<annotation> <primary>, the annotation covers just the one operand
+// so bigger expressions need parentheses
+static std::unique_ptr<ExpressionAST> ParseAnnotatedExpr() {
+	if(GetNextToken() != Token::TokenIdentifier)
+		return LogError("> Expected an annotation name after '@'");
+
+	const ExpressionAnnotation * annotation = FindName(ExpressionAnnotationNames, IdentifierStr);
+	if(!annotation)
+		return LogError("> Unknown expression annotation");
+
+	GetNextToken();
+	return ParseAnnotated(*annotation);
+}
+
+// argument lists are reserved this big the moment they get their
+// first entry, so a short one is a single allocation rather than one
+// per doubling
+constexpr size_t ShortArgList = 4;
+
 // variables and function types will be ommited until I link this
 // with LLVM and can actual optimize the bytecode to produce
 // efficient, static typing
-static std::unique_ptr<ExpressionAST> ParseIdentifierExpr(const Type & _type) {
-//	Types Id_type = _type;
-//	GetNextToken();
-	
-	std::string Id_name = IdentifierStr;
+static std::unique_ptr<ExpressionAST> ParseIdentifierExpr() {
+	// the lexer writes IdentifierStr afresh for the next one anyway
+	std::string Id_name = std::move(IdentifierStr);
 	GetNextToken();
 
 	if(CurrentToken != '(')
-		return std::make_unique<ExpressionAST> (Id_name);
-	
+		return std::make_unique<VariableExpressionAST> (Types::NONE, std::move(Id_name));
+
+	GetNextToken();
+
 	std::vector<std::unique_ptr<ExpressionAST>> _args;
 	if(CurrentToken != ')') {
+		_args.reserve(ShortArgList);
+
 		while(true) {
 			if(auto _arg = ParseExpression()) {
-				_args.push_back(_arg);
+				_args.emplace_back(std::move(_arg));
 			} else {
 				return nullptr;
 			}
@@ -198,7 +644,7 @@ static std::unique_ptr<ExpressionAST> ParseIdentifierExpr(const Type & _type) {
 	}
 
 	GetNextToken();
-	return std::make_unique<FunctionAST> (/* type */, Id_name, std::move(_args));
+	return std::make_unique<FuncCallAST> (std::move(Id_name), std::move(_args));
 }
 
 // main recursive function for parsing identifiers and
@@ -209,36 +655,30 @@ static std::unique_ptr<ExpressionAST> ParsePrimary() {
 		case Token::TokenIdentifier:
 			return ParseIdentifierExpr();
 
-		case Token::Token_func:
-			return ParseParentExpression();
-
 		case Token::TokenNumber:
-			return ParseNumberExpression();
+			return ParseNumExpr(NumberValue);
 
 		// Types which we'll do later
 		// marked with unlikely so I can
 		// compile the first build and respectively,
 		// work on these later...
 	[[unlikely]] case Token::Token_i32:
-			return ParseIntegerExpression();
-
 	[[unlikely]] case Token::Token_u32:
-			return ParseUIntegerExpression();
-
 	[[unlikely]] case Token::Token_char:
-			return ParseCharacterExpression();
-
 	[[unlikely]] case Token::Token_uchar:
-			return ParseUCharacterExpression();
-
 	[[unlikely]] case Token::Token_str:
-			return ParseStrExpression();
-
 	[[unlikely]] case Token::Token_f32:
-			return ParseFloatExpression();
-
 	[[unlikely]] case Token::Token_uf32:
-			return ParseUFloatExpression();
+			return LogError("> Typed expressions aren't supported yet");
+
+		case Token::Token_if:
+			return ParseIfExpr();
+
+		case '(':
+			return ParseParentExpr();
+
+		case '@':
+			return ParseAnnotatedExpr();
 
 		default:
 			return LogError("> Unkown token while parsing");
@@ -246,21 +686,19 @@ static std::unique_ptr<ExpressionAST> ParsePrimary() {
 }
 
 // KV pairs associates the binary operation with
-// its precedence via a map
-static std::map<char, int> BinOpPrecedence;
+// its precedence via a map, keyed on the operator's
+// token so <=, && and friends have a place too
+static std::map<int, int> BinOpPrecedence;
 
 // basic getter function for returning precedence
 // will be some arbitrary value until I decide
 // how the language should handle these return codes
-static int GetTokenPrecedence() const {
-	if(!isascii(CurrentToken))
-		return -1;
-
-	int TokenPrecedence = BinOpPrecedence;
-	if(TokenPrecedence <= 0)
+static int GetTokenPrecedence() {
+	auto it = BinOpPrecedence.find(CurrentToken);
+	if(it == BinOpPrecedence.end() || it->second <= 0)
 		return -1;
 
-	return TokenPrecedence;
+	return it->second;
 }
 
 #pragma region BINARY_OPERATIONS
@@ -291,22 +729,23 @@ static std::unique_ptr<ExpressionAST> ParseBinaryOpRHS(const int ExprPrecedence,
 		if(TokenPrecedence < ExprPrecedence)
 			return LHS;
 
-		int BinaryOp = CurrentToken();
+		int BinaryOp = CurrentToken;
 		GetNextToken();
 
 		auto RHS = ParsePrimary();
 		if(!RHS)
 			return nullptr;
 		
-		int NextPrecedence = GetTOkenPrecedence();
-		
-		// marked with unlikely now as ill figure this
-		// out later, a lot of work is to be done.
-		[[unlikely]]
-		if(TokenPrecedence < NextPrecedence)
-			return nullptr;
+		// a tighter operator after the RHS takes it as its own LHS,
+		// i.e a < b + c is a < (b + c)
+		int NextPrecedence = GetTokenPrecedence();
+		if(TokenPrecedence < NextPrecedence) {
+			RHS = ParseBinaryOpRHS(TokenPrecedence + 1, std::move(RHS));
+			if(!RHS)
+				return nullptr;
+		}
 	
-		LHS = std::make_unique<BinaryExprAST> (BinaryOp, std::move(LHS), 
+		LHS = std::make_unique<BinaryExpressionAST> (BinaryOp, std::move(LHS),
 			std::move(RHS));
 	}
 }
@@ -315,30 +754,83 @@ static std::unique_ptr<ExpressionAST> ParseBinaryOpRHS(const int ExprPrecedence,
 
 #pragma region TOKEN_PARSER_FUNCTIONS
 
+// parses any number of @attribute's, i.e. the ones in front of a
+// function's name or a top level expression. With _annotation a name
+// that's only an expression annotation (@likely and friends) ends the
+// attributes instead, it's left in _annotation for the expression
+static bool ParseAttributes(std::vector<FunctionAttribute> & _attributes,
+		const ExpressionAnnotation ** _annotation = nullptr) {
+	while(CurrentToken == '@') {
+		if(GetNextToken() != Token::TokenIdentifier) {
+			LogError("> Expected an attribute name after '@'");
+			return false;
+		}
+
+		const FunctionAttribute * attr = FindName(FunctionAttributeNames, IdentifierStr);
+		if(!attr && _annotation) {
+			*_annotation = FindName(ExpressionAnnotationNames, IdentifierStr);
+			if(*_annotation) {
+				GetNextToken();
+				break;
+			}
+		}
+
+		if(!attr) {
+			LogError("> Unknown function attribute");
+			return false;
+		}
+
+		_attributes.push_back(*attr);
+		GetNextToken();
+	}
+
+	for(const auto & [a, b] : ConflictingAttributes) {
+		if(std::count(_attributes.begin(), _attributes.end(), a)
+				&& std::count(_attributes.begin(), _attributes.end(), b)) {
+			LogError("> Conflicting function attributes");
+			return false;
+		}
+	}
+
+	return true;
+}
+
 // parse function prototypes i.e declarations
 static std::unique_ptr<PrototypeAST> ParsePrototype() {
+	std::vector<FunctionAttribute> attributes;
+	if(!ParseAttributes(attributes))
+		return nullptr;
+
 	if(CurrentToken != Token::TokenIdentifier) 
 		return LogErrorProto("> Expected a function name in prototype\n");
 
-	std::string full_name = IdentifierStr;
+	std::string full_name = std::move(IdentifierStr);
 	GetNextToken();
 
 	if(CurrentToken != '(')
 		return LogErrorProto("> Expected '(' in prototype");
 
 	std::vector<std::string> arg_names;
-	while(GetNextToken() == Token::TokenIdentifier)
-		arg_names.push_name(IdentifierStr);
+	while(GetNextToken() == Token::TokenIdentifier) {
+		if(arg_names.empty())
+			arg_names.reserve(ShortArgList);
+
+		arg_names.emplace_back(std::move(IdentifierStr));
+	}
 
 	if(CurrentToken != ')')
 		return LogErrorProto("> Expected ')' in prototpye");
 
 	GetNextToken();
 
-	return std::make_unique<PrototypeAST> (full_name, std::move(arg_names));
+	auto proto = std::make_unique<PrototypeAST> (std::move(full_name), std::move(arg_names));
+	for(FunctionAttribute attr : attributes)
+		proto->addAttribute(attr);
+
+	return proto;
 }
 
-static std::unique_ptr<FunctionAST ParseDefinition() {
+static std::unique_ptr<FunctionAST> ParseDefinition() {
 	GetNextToken();
 
 	auto Prototype = ParsePrototype();
@@ -351,185 +843,3237 @@ static std::unique_ptr<FunctionAST ParseDefinition() {
 	return nullptr;
 }
 
-static std::uniqure_ptr<FunctionAST> ParseTopLevelExpr() {
-	if(auto e = ParseExpression()) {
-		auto proto = std::make_unique<PrototypeExpr> ("__anon_epxr", 
-				std::vector<std::string>());
+// the C type a type keyword stands for in an extern signature, no
+// keyword at all means double. false if there was a keyword but
+// it has no C equivalent
+static bool ParseExternType(Types & _type) {
+	switch(CurrentToken) {
+		case Token::Token_i32:		_type = Types::I32; break;
+		case Token::Token_u32:		_type = Types::U32; break;
+		case Token::Token_f32:		_type = Types::F32; break;
+		case Token::Token_char:		_type = Types::CHAR; break;
+		case Token::Token_uchar:	_type = Types::UCHAR; break;
+		case Token::Token_bool:		_type = Types::BOOL; break;
+
+		case Token::Token_str:
+		case Token::Token_uf32:
+			LogError("> Type can't be passed to an extern");
+			return false;
 
-		return std::make_unique<FunctionAST> (std::move(proto), std::move(e));
+		default:
+			_type = Types::NONE;
+			return true;
 	}
 
-	return nullptr;
+	GetNextToken();
+	return true;
 }
 
-#pragma endregion
+// extern <type>? <name> ( <type>? <arg> ... ) i.e.
+// extern i32 putchar(i32 c) or extern hypot(x y)
+static std::unique_ptr<PrototypeAST> ParseExtern() {
+	GetNextToken();
 
-#pragma region RDP_LOOP
+	Types return_type {Types::NONE};
+	if(!ParseExternType(return_type))
+		return nullptr;
 
-static void repl() {
-	while(true) {
-		fprintf(stderr, "> Ready! ");
+	if(CurrentToken != Token::TokenIdentifier)
+		return LogErrorProto("> Expected a function name after extern");
 
-		switch(CurrentToken()) {
-			case Token::Token_TokenEOF:
-				return;
-			
-			case ';':
-				GetNextToken();
-				break;
+	std::string name = std::move(IdentifierStr);
 
-			case Token::Token_func:
-				HandleFuncDefinition();
-				break;
+	if(GetNextToken() != '(')
+		return LogErrorProto("> Expected '(' in extern declaration");
 
-			case Token::TokenNumber:
-				HandleNumLitDefinition();
-				break;
+	GetNextToken();
 
-		[[unlikely]] case Token::Token_i32:
-				Handlei32();
-				break;
+	std::vector<std::string> arg_names;
+	std::vector<Types> arg_types;
 
-		[[unlikely]] case Token::Token_u32:
-				Handleu32();
-				break;
-		
-		[[unlikely]] case Token::Token_char:
-				Handlechar();
-				break;
-		
-		[[unlikely]] case Token::Token_uchar:
-				Handleuchar();
-				break;
-		
-		[[unlikely]] case Token::Token_str:
-				HandleStr();
-				break;
-		
-		[[unlikely]] case Token::Token_f32:
-				Handlef32();
-				break;
-		
-		[[unlikely]] case Token::Token_uf32:
-				Handleuf32();				
-				break;
-			
-			default:
-				HandleTopLevelExpression();
-				break;
-		}
+	while(CurrentToken != ')') {
+		Types type {Types::NONE};
+		if(!ParseExternType(type))
+			return nullptr;
+
+		if(CurrentToken != Token::TokenIdentifier)
+			return LogErrorProto("> Expected an argument name in extern declaration");
+
+		arg_names.emplace_back(std::move(IdentifierStr));
+		arg_types.push_back(type);
+		GetNextToken();
 	}
-}
 
-#pragma endregion
+	GetNextToken();
 
-#pragma region CODEGEN_IMPL
+	auto proto = std::make_unique<PrototypeAST> (std::move(name), std::move(arg_names),
+			return_type, Signatures.intern(arg_types));
+	proto->markExtern();
 
-Value * NumberExpressionAST::codegen() {
-	return ConstantFP::get(*TheContext, APFLoat(Val));
+	return proto;
 }
 
-Value * VariableExpressionAST::codegen() {
-	Value* V = NamedValues[Name];
+// the expression itself may start with an annotation, @fastmath and
+// @strict in front of it are taken as attributes of the whole thing
+static std::unique_ptr<FunctionAST> ParseTopLevelExpr() {
+	std::vector<FunctionAttribute> attributes;
+	const ExpressionAnnotation * annotation {nullptr};
+	if(!ParseAttributes(attributes, &annotation))
+		return nullptr;
+
+	std::unique_ptr<ExpressionAST> e;
+	if(!annotation)
+		e = ParseExpression();
+	else if(auto lhs = ParseAnnotated(*annotation))
+		e = ParseBinaryOpRHS(0, std::move(lhs));
+
+	if(e) {
+		auto proto = std::make_unique<PrototypeAST> ("__anon_epxr",
+				std::vector<std::string> {});
 
-	if(!V) LogErrorV("> Unkown Variable name");
+		for(FunctionAttribute attr : attributes)
+			proto->addAttribute(attr);
 
-	return V;
+		return std::make_unique<FunctionAST> (std::move(proto), std::move(e));
+	}
+
+	return nullptr;
 }
 
-Value * BinaryExpressionAST() {
-	Value* L = LHS->codegen();
-	Value* R = RHS->codegen();
+#pragma endregion
 
-	if(!L || !R) return nullptr;
+#pragma region TIERING
 
-	switch(Op) {
-		case '+':
-			return Builder->CreateFAdd(L, R, "addtmp");
+// the interpreter tier and the JIT it promotes into, top level
+// expressions and fresh definitions only ever reach LLVM once
+// they're hot or use something the bytecode can't express
+static std::unique_ptr<BytecodeModule> TheBytecode;
+static ExitOnError ExitOnErr;
 
-		case '-':
-			return Builder->CreatFSub(L, R, "subtmp");
+// the JIT, and with it LLVM's target, is only set up the first time
+// something needs native code. A short script the interpreter gets
+// through on its own never initializes LLVM at all
+static std::unique_ptr<ModKJIT> TheJIT;
+static std::once_flag TheJITOnce;
+static unsigned JITCompileThreads {0};
 
-		case '*':
-			return Builder->CreateFMul(L, R, "multmp");
+static bool CompileForJIT(const std::string & _name);
 
-		case '<':
-			L = Builder->CreateFCmpULT(L, R, "cmptmp");
-			return Builder->CreateUIToFP(L, Type::getDoubleTy(*TheContext),
-					"booltmp");
+static ModKJIT & GetJIT() {
+	std::call_once(TheJITOnce, [] {
+		// no inline assembly ever gets emitted, so no asm parser
+		InitializeNativeTarget();
+		InitializeNativeTargetAsmPrinter();
 
-		default:
-			LogErrorV("> Invalid Binary Operator");
-	}
+		TheJIT = ExitOnErr(ModKJIT::Create([](StringRef _name) {
+			return CompileForJIT(_name.str());
+		}, JITCompileThreads));
+
+		if(HotReload)
+			ExitOnErr(TheJIT->enableRedefinition());
+	});
+
+	return *TheJIT;
 }
 
-Value * CallExpressionAST::codegen() {
-	Function * Callee = TheModule->getFunction(Caller);
+// names already handed to the JIT, and those added while a lookup
+// was in flight whose addresses still need patching into the bytecode
+static std::set<std::string> NativeFunctions;
+static std::vector<std::string> PendingNative;
+
+// guards the two above, the fallback generator can run on the JIT's
+// compile threads while the main thread compiles or looks things up
+static std::mutex CodegenMutex;
+
+// with HotReload, the version of each function its stub calls and the
+// tracker owning that version's code. Numbers are handed out as
+// versions are started, so ones that failed to compile leave gaps
+struct NativeVersion {
+	unsigned m_Allocated {0};
+	unsigned m_Current {0};
+	ResourceTrackerSP m_Tracker;
+};
 
-	if(!Callee)
-		return LogErrorV("> Unknown Function Referenced");
+static std::map<std::string, NativeVersion> NativeVersions;
 
-	if(Callee->arg_size() != m_Args.size())
+static std::string VersionName(const std::string & _name, const unsigned _number) {
+	return _name + ".v" + std::to_string(_number);
+}
+
+// Code of replaced versions. ModK code only ever runs on the main thread
+// and only while a top level item is being handled, so between two items
+// nothing can still be inside an old version and it's freed there
+static std::vector<ResourceTrackerSP> RetiredVersions;
+
+static void ReclaimRetiredVersions() {
+	for(ResourceTrackerSP & tracker : RetiredVersions)
+		consumeError(tracker->remove());
+
+	RetiredVersions.clear();
+}
+
+// what a redefinition has to revisit, keyed by the callee. Callers go
+// through its stub so a new version reaches them by itself, Baked are
+// the functions holding on to something of the current version: a call
+// folded at compile time or its body inlined. Only kept with HotReload
+struct FunctionUses {
+	std::set<std::string> m_Callers;
+	std::set<std::string> m_Baked;
+};
+
+static std::mutex UsesMutex;
+static std::map<std::string, FunctionUses> Uses;
+
+static void RecordUse(const std::string & _callee, const std::string & _user, const bool _baked) {
+	if(!HotReload)
+		return;
+
+	std::lock_guard<std::mutex> lock {UsesMutex};
+	FunctionUses & uses = Uses[_callee];
+	(_baked ? uses.m_Baked : uses.m_Callers).insert(_user);
+}
+
+// the function whose body is being generated on this thread
+static std::string CodegenUser() {
+	return Builder->GetInsertBlock()->getParent()->getName().str();
+}
+
+// Layout. Hot functions go in .text.hot and cold ones in .text.unlikely,
+// which is what the linker groups object file code by and what the
+// JIT's code memory pool picks slabs by. Hotness is @hot/@cold first,
+// then the counts from --profile, and without a profile the
+// interpreter's own call counters
+enum class Hotness : uint8_t {
+	Cold,
+	Normal,
+	Hot
+};
+
+// "name count" a line, as --write-profile writes them
+static std::map<std::string, uint64_t> ProfileCounts;
+
+static bool LoadProfile(const char * _path) {
+	FILE * in = fopen(_path, "r");
+	if(!in)
+		return false;
+
+	char name[256];
+	unsigned long long count {0};
+
+	while(fscanf(in, "%255s %llu", name, &count) == 2)
+		ProfileCounts[name] = count;
+
+	fclose(in);
+	return true;
+}
+
+// native code doesn't count calls, having been promoted means a
+// function made it to TierUpThreshold at least
+static uint64_t CallCount(const BytecodeFunction & _fn) {
+	return _fn.m_Native ? std::max<uint64_t>(_fn.m_CallCount, TierUpThreshold) : _fn.m_CallCount;
+}
+
+static bool WriteProfile(const char * _path) {
+	FILE * out = fopen(_path, "w");
+	if(!out)
+		return false;
+
+	for(size_t i {0}; i != TheBytecode->size(); ++i) {
+		const BytecodeFunction & fn = TheBytecode->at(static_cast<uint16_t>(i));
+
+		if(const uint64_t count = CallCount(fn))
+			fprintf(out, "%s %llu\n", fn.m_Name.c_str(), static_cast<unsigned long long>(count));
+	}
+
+	return fclose(out) == 0;
+}
+
+static uint64_t ProfileCount(const std::string & _name) {
+	if(!ProfileCounts.empty()) {
+		auto it = ProfileCounts.find(_name);
+		return it == ProfileCounts.end() ? 0 : it->second;
+	}
+
+	const BytecodeFunction * bc = TheBytecode->lookup(_name);
+	return bc ? CallCount(*bc) : 0;
+}
+
+static Hotness FunctionHotness(const PrototypeAST & _proto) {
+	if(_proto.hasAttribute(FunctionAttribute::Hot))
+		return Hotness::Hot;
+
+	if(_proto.hasAttribute(FunctionAttribute::Cold))
+		return Hotness::Cold;
+
+	// top level expressions aren't in any profile
+	if(!FunctionDefinitions.count(_proto.getName()))
+		return Hotness::Normal;
+
+	const uint64_t count = ProfileCount(_proto.getName());
+	if(count >= TierUpThreshold)
+		return Hotness::Hot;
+
+	// only a profiled run that never called it says it's cold, without
+	// one no calls yet could just as well mean it was just defined
+	return !count && !ProfileCounts.empty() ? Hotness::Cold : Hotness::Normal;
+}
+
+// codegens a definition into its own module and adds it to the JIT
+// without looking it up, so it's safe to call from inside a lookup
+static bool CompileForJIT(const std::string & _name) {
+	std::lock_guard<std::mutex> lock {CodegenMutex};
+
+	if(NativeFunctions.count(_name) || RetiredFunctions.count(_name))
+		return true;
+
+	auto it = FunctionDefinitions.find(_name);
+	if(it == FunctionDefinitions.end())
+		return false;
+
+	InitializeModule();
+	Function * fn = it->second->codegen();
+	if(!fn)
+		return false;
+
+	ThreadSafeModule module {std::move(TheModule), std::move(TheContext)};
+
+	// only ever the first version, later ones come from RedefineFunction
+	if(GetJIT().redefinable()) {
+		NativeVersion & version = NativeVersions[_name];
+		const unsigned number = ++version.m_Allocated;
+		const std::string impl = VersionName(_name, number);
+		ResourceTrackerSP tracker = GetJIT().createVersionTracker();
+
+		fn->setName(impl);
+		if(auto err = GetJIT().addVersion(std::move(module), _name, impl, tracker)) {
+			LogError(toString(std::move(err)).c_str());
+			return false;
+		}
+
+		version.m_Current = number;
+		version.m_Tracker = std::move(tracker);
+	} else if(auto err = GetJIT().addModule(std::move(module))) {
+		LogError(toString(std::move(err)).c_str());
+		return false;
+	}
+
+	NativeFunctions.insert(_name);
+	PendingNative.push_back(_name);
+
+	return true;
+}
+
+// looks _name up in the JIT and patches every function the lookup
+// dragged in (through the fallback generator) into the bytecode module
+static void * LookupNative(const std::string & _name) {
+	auto sym = GetJIT().lookup(_name);
+
+	std::vector<std::string> pending;
+	{
+		std::lock_guard<std::mutex> lock {CodegenMutex};
+		pending.swap(PendingNative);
+	}
+
+	if(!sym) {
+		LogError(toString(sym.takeError()).c_str());
+		return nullptr;
+	}
+
+	for(const auto & name : pending) {
+		BytecodeFunction * fn = TheBytecode->lookup(name);
+		if(!fn || fn->m_Native)
+			continue;
+
+		if(auto addr = GetJIT().lookup(name))
+			fn->m_Native = *addr;
+		else
+			consumeError(addr.takeError());
+	}
+
+	return *sym;
+}
+
+// Batch compile of _names straight to native code, as three jobs per
+// function: codegen into a module of its own, optimize, emit. Callees
+// are only ever declared (getFunction works off FunctionDefinitions,
+// not off what was generated before), so no body waits on another and
+// the scheduler is free to run them in any order. The objects are then
+// added to the JIT together and its linker resolves the calls between
+// them, they skip the IR layers since they're already optimized
+//
+// with _recompile functions that are native already get a new version
+// too, which is swapped in behind their stub (only with HotReload)
+static void CompileAllForJIT(const std::vector<std::string> & _names, const bool _recompile = false) {
+	struct FunctionJob {
+		std::string m_Name {};
+		std::unique_ptr<LLVMContext> m_Context;
+		std::unique_ptr<Module> m_Module;
+		std::unique_ptr<MemoryBuffer> m_Object;
+
+		// versioned symbol and its tracker when the JIT is redefinable,
+		// m_Replaces is the version currently behind the stub (0 if none)
+		std::string m_Impl {};
+		ResourceTrackerSP m_Tracker;
+		unsigned m_Version {0};
+		unsigned m_Replaces {0};
+	};
+
+	std::vector<FunctionJob> batch;
+
+	// claimed up front so the fallback generator leaves them alone
+	{
+		std::lock_guard<std::mutex> lock {CodegenMutex};
+
+		for(const auto & name : _names) {
+			if(!FunctionDefinitions.count(name))
+				continue;
+
+			const bool claimed = NativeFunctions.insert(name).second;
+			if(!claimed && !(_recompile && GetJIT().redefinable()))
+				continue;
+
+			FunctionJob & job = batch.emplace_back();
+			job.m_Name = name;
+
+			if(GetJIT().redefinable()) {
+				NativeVersion & version = NativeVersions[name];
+				job.m_Version = ++version.m_Allocated;
+				job.m_Replaces = version.m_Current;
+				job.m_Impl = VersionName(name, job.m_Version);
+				job.m_Tracker = GetJIT().createVersionTracker();
+			}
+		}
+	}
+
+	if(batch.empty())
+		return;
+
+	JobScheduler scheduler {JobCount()};
+
+	for(FunctionJob & fn : batch) {
+		auto codegen = scheduler.add("codegen " + fn.m_Name, [&fn] {
+			InitializeModule();
+			TheModule->setDataLayout(GetJIT().getDataLayout());
+			TheModule->setTargetTriple(GetJIT().getTargetTriple().str());
+
+			Function * f = FunctionDefinitions.at(fn.m_Name)->codegen();
+			if(!f)
+				return;
+
+			if(!fn.m_Impl.empty())
+				f->setName(fn.m_Impl);
+
+			fn.m_Module = std::move(TheModule);
+			fn.m_Context = std::move(TheContext);
+		});
+
+		auto optimize = scheduler.add("optimize " + fn.m_Name, [&fn] {
+			if(!fn.m_Module)
+				return;
+
+			if(auto target = GetJIT().getThreadTargetMachine())
+				OptimizeModule(*fn.m_Module, *target);
+			else
+				LogError(toString(target.takeError()).c_str());
+		});
+
+		auto emit = scheduler.add("emit " + fn.m_Name, [&fn] {
+			if(!fn.m_Module)
+				return;
+
+			if(auto object = GetJIT().emitObject(*fn.m_Module))
+				fn.m_Object = std::move(*object);
+			else
+				LogError(toString(object.takeError()).c_str());
+
+			fn.m_Module.reset();
+			fn.m_Context.reset();
+		});
+
+		scheduler.depends(optimize, codegen);
+		scheduler.depends(emit, optimize);
+	}
+
+	scheduler.run();
+
+	if(ReportJobs)
+		scheduler.report(stderr);
+
+	std::vector<std::string> compiled;
+
+	std::vector<FunctionJob *> swaps;
+
+	for(FunctionJob & fn : batch) {
+		if(!fn.m_Object)
+			continue;
+
+		if(auto err = fn.m_Impl.empty() ? GetJIT().addObject(std::move(fn.m_Object))
+				: GetJIT().addVersionObject(std::move(fn.m_Object), fn.m_Name, fn.m_Impl, fn.m_Tracker)) {
+			LogError(toString(std::move(err)).c_str());
+			continue;
+		}
+
+		compiled.push_back(fn.m_Name);
+
+		if(fn.m_Replaces)
+			swaps.push_back(&fn);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock {CodegenMutex};
+
+		for(const FunctionJob & fn : batch) {
+			const bool ok = std::find(compiled.begin(), compiled.end(), fn.m_Name) != compiled.end();
+
+			// a failed recompile leaves the running version where it is
+			if(!ok && !fn.m_Replaces)
+				NativeFunctions.erase(fn.m_Name);
+
+			// first versions are resolved by their stub on the first call
+			if(ok && !fn.m_Impl.empty() && !fn.m_Replaces) {
+				NativeVersion & version = NativeVersions[fn.m_Name];
+				version.m_Current = fn.m_Version;
+				version.m_Tracker = fn.m_Tracker;
+			}
+		}
+
+		PendingNative.insert(PendingNative.end(), compiled.begin(), compiled.end());
+	}
+
+	// LookupNative resolves everything pending, so a single call
+	// links the batch and patches it into the bytecode module
+	if(!compiled.empty())
+		LookupNative(compiled.front());
+
+	// the swap links the new version, which may pull in callees through
+	// the fallback generator, so the lock can't be held over it
+	for(FunctionJob * fn : swaps) {
+		if(auto err = GetJIT().swapVersion(fn->m_Name, fn->m_Impl)) {
+			LogError(toString(std::move(err)).c_str());
+			consumeError(fn->m_Tracker->remove());
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock {CodegenMutex};
+		NativeVersion & version = NativeVersions[fn->m_Name];
+
+		RetiredVersions.push_back(std::move(version.m_Tracker));
+		version.m_Current = fn->m_Version;
+		version.m_Tracker = fn->m_Tracker;
+	}
+}
+
+// tier-up hook, callees that are still interpreted get compiled
+// lazily when the JIT fails to resolve them while linking _fn
+static bool PromoteToNative(BytecodeFunction & _fn) {
+	if(!CompileForJIT(_fn.m_Name))
+		return false;
+
+	if(void * addr = LookupNative(_fn.m_Name))
+		_fn.m_Native = addr;
+
+	return _fn.m_Native != nullptr;
+}
+
+// Streaming mode, definitions are compiled natively StreamBatchSize
+// at a time and then retired: the AST and bytecode are dropped and
+// only the arity and attributes are kept, the IR already went with the
+// JIT. Still resident per function, about 600 bytes of heap: that
+// RetiredFunction, the bytecode slot (interpreted callers index into
+// it, so it can't go) with its name, and on the JIT side the machine
+// code, the symbol, the object's memory manager and its unwind info
+static constexpr size_t StreamBatchSize = 256;
+static std::vector<std::string> StreamBatch;
+static size_t StreamedFunctions {0};
+
+// resident set size in bytes, 0 where /proc isn't around
+static size_t CurrentRSS() {
+	FILE * statm = fopen("/proc/self/statm", "r");
+	if(!statm)
+		return 0;
+
+	unsigned long pages {0}, resident {0};
+	if(fscanf(statm, "%lu %lu", &pages, &resident) != 2)
+		resident = 0;
+
+	fclose(statm);
+	return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static void FlushStream() {
+	if(StreamBatch.empty())
+		return;
+
+	CompileAllForJIT(StreamBatch);
+
+	for(const auto & name : StreamBatch) {
+		{
+			// whatever didn't make it to native code keeps its AST so
+			// the interpreter or a later lookup can still get at it
+			std::lock_guard<std::mutex> lock {CodegenMutex};
+			if(!NativeFunctions.erase(name))
+				continue;
+
+			auto it = FunctionDefinitions.find(name);
+			const PrototypeAST & proto = it->second->getProto();
+
+			RetiredFunctions[name] = RetiredFunction {static_cast<uint32_t>(proto.getArgs().size()),
+				proto.getAttributes()};
+			FunctionDefinitions.erase(it);
+		}
+
+		if(BytecodeFunction * bc = TheBytecode->lookup(name); bc && bc->m_Native) {
+			std::vector<BytecodeInstruction>().swap(bc->m_Code);
+			std::vector<double>().swap(bc->m_Constants);
+		}
+	}
+
+	const size_t before = StreamedFunctions;
+	StreamedFunctions += StreamBatch.size();
+	StreamBatch.clear();
+
+	if(before / 100'000 != StreamedFunctions / 100'000)
+		fprintf(stderr, "> %zu functions streamed, rss %.1f MB\n", StreamedFunctions,
+				CurrentRSS() / (1024.0 * 1024.0));
+}
+
+static void StreamDefinition(const std::string & _name) {
+	StreamBatch.push_back(_name);
+
+	if(StreamBatch.size() >= StreamBatchSize)
+		FlushStream();
+}
+
+// points the JIT's symbol for _name at the host's, once
+static bool BindExtern(const std::string & _name) {
+	if(BoundExterns.count(_name))
+		return true;
+
+	void * address = FindExternSymbol(_name);
+	if(!address) {
+		fprintf(stderr, "> Error: no symbol %s in the host process or any loaded library\n",
+				_name.c_str());
+		return false;
+	}
+
+	if(auto err = GetJIT().defineAbsolute(_name, address)) {
+		LogError(toString(std::move(err)).c_str());
+		return false;
+	}
+
+	BoundExterns.insert(_name);
+	return true;
+}
+
+// binds an extern to its host symbol right away, so a missing symbol
+// is reported at the declaration rather than at some later call. The
+// bytecode has no way to call one, so any function that does is
+// compiled natively from the start
+static void DeclareExtern(std::unique_ptr<PrototypeAST> _proto) {
+	const std::string name = _proto->getName();
+
+	// a shared prelude declares the same externs over and over, the
+	// first time may have been for an object file though
+	if(auto it = ExternFunctions.find(name); it != ExternFunctions.end()
+			&& it->second->getArgTypes() == _proto->getArgTypes()
+			&& it->second->getReturnType() == _proto->getReturnType()) {
+		if(ObjectOutput.empty())
+			BindExtern(name);
+
+		return;
+	}
+
+	if(FunctionDefinitions.count(name) || RetiredFunctions.count(name) || ExternFunctions.count(name)) {
+		LogError("> Extern cannot be redeclared");
+		return;
+	}
+
+	if(IsReservedName(name)) {
+		LogError("> Extern name is reserved for a builtin");
+		return;
+	}
+
+	// object files leave the symbol for the linker to find
+	if(ObjectOutput.empty() && !BindExtern(name))
+		return;
+
+	ExternFunctions[name] = std::move(_proto);
+	fprintf(stderr, "> Read extern: %s\n", name.c_str());
+}
+
+static void RedefineFunction(std::unique_ptr<FunctionAST> _fn);
+
+// same attributes and the same body up to what the parameters are called
+static bool SameDefinition(const FunctionAST & _a, const FunctionAST & _b) {
+	if(_a.getProto().getAttributes() != _b.getProto().getAttributes())
+		return false;
+
+	AstFingerprint a, b;
+	_a.fingerprint(a);
+	_b.fingerprint(b);
+
+	return a.valid() && b.valid() && a.bytes() == b.bytes();
+}
+
+static void DefineFunction(std::unique_ptr<FunctionAST> _fn) {
+	const std::string name = _fn->getName();
+
+	ReclaimRetiredVersions();
+
+	// resubmitted as it was, whatever was compiled for it still holds
+	if(auto it = FunctionDefinitions.find(name); it != FunctionDefinitions.end()
+			&& SameDefinition(*it->second, *_fn)) {
+		fprintf(stderr, "> Function unchanged: %s\n", name.c_str());
+		return;
+	}
+
+	if(HotReload && FunctionDefinitions.count(name)) {
+		RedefineFunction(std::move(_fn));
+		return;
+	}
+
+	if(FunctionDefinitions.count(name) || RetiredFunctions.count(name) || ExternFunctions.count(name)) {
+		LogError("> Func cannot be redefined");
+		return;
+	}
+
+	if(IsReservedName(name)) {
+		LogError("> Func name is reserved for a builtin");
+		return;
+	}
+
+	BytecodeFunction * bc = TheBytecode->declare(name);
+	if(!bc && !Streaming) {
+		LogError("> Too many functions for the interpreter");
+		return;
+	}
+
+	const FunctionAST & fn = *(FunctionDefinitions[name] = std::move(_fn));
+
+	// past the interpreter's limit a streamed definition is native only
+	if(!bc) {
+		StreamDefinition(name);
+		fprintf(stderr, "> Read function definition: %s\n", name.c_str());
+		return;
+	}
+
+	bool lowered = fn.lower(*TheBytecode, *bc);
+	InferEffects(*TheBytecode);
+
+	// caching an impure function would change what it does
+	if(fn.getProto().hasAttribute(FunctionAttribute::Memo)) {
+		if(bc->m_Effects.m_ReadNone && bc->m_Effects.m_NoUnwind)
+			bc->m_Memo = GetMemoCache(name, bc->m_NumParams);
+
+		if(!bc->m_Memo)
+			fprintf(stderr, "> Warning: @memo ignored on %s, it's either impure or takes "
+					"more than %u arguments\n", name.c_str(), MaxMemoArgs);
+	}
+
+	// anything the bytecode can't express goes straight to the JIT,
+	// object files are generated from the AST and don't need it
+	if(!lowered && ObjectOutput.empty() && !PromoteToNative(*bc)) {
+		FunctionDefinitions.erase(name);
+		return;
+	}
+
+	// @hot skips the interpreter's warmup, it would only end up native anyway
+	if(lowered && !Streaming && ObjectOutput.empty() && fn.getProto().hasAttribute(FunctionAttribute::Hot)
+			&& !bc->m_Native)
+		PromoteToNative(*bc);
+
+	if(Streaming)
+		StreamDefinition(name);
+
+	fprintf(stderr, "> Read function definition: %s\n", name.c_str());
+}
+
+// a top level expression as it sits in the expression cache, the AST
+// is kept so the entry can still be compiled once it gets hot and the
+// native code lives exactly as long as the entry does
+struct CachedExpression {
+	std::unique_ptr<FunctionAST> m_Ast;
+	BytecodeFunction m_Code;
+	bool m_Lowered {false};
+
+	// hoisted kernels take their literals as double(const double *)
+	bool m_Hoisted {false};
+
+	std::atomic<uint32_t> m_Runs {0};
+	std::atomic<void *> m_Native {nullptr};
+	ResourceTrackerSP m_Tracker;
+
+	~CachedExpression() {
+		if(m_Tracker)
+			consumeError(m_Tracker->remove());
+	}
+};
+
+// keyed on the alpha-normalized AST, resubmitting an expression we've
+// seen before costs a parse and a lookup
+static LruCache<std::string, std::shared_ptr<CachedExpression>> ExpressionCache {
+	ExpressionCacheCapacity
+};
+
+static unsigned AnonExpressionCount {0};
+
+static bool CompileExpression(CachedExpression & _entry) {
+	auto tracker = GetJIT().createResourceTracker();
+	std::string name;
+
+	{
+		std::lock_guard<std::mutex> lock {CodegenMutex};
+
+		InitializeModule();
+		Function * fn = _entry.m_Ast->codegen();
+		if(!fn)
+			return false;
+
+		// cached expressions stay in the JIT, so each needs its own symbol
+		name = "__anon_epxr." + std::to_string(AnonExpressionCount++);
+		fn->setName(name);
+
+		if(auto err = GetJIT().addModule(ThreadSafeModule(std::move(TheModule), std::move(TheContext)),
+					tracker)) {
+			LogError(toString(std::move(err)).c_str());
+			return false;
+		}
+	}
+
+	_entry.m_Tracker = std::move(tracker);
+
+	void * addr = LookupNative(name);
+	_entry.m_Native = addr;
+
+	return addr != nullptr;
+}
+
+// cold expressions only ever see the interpreter, the JIT is the
+// fallback for whatever the bytecode can't express and for cached
+// expressions that keep getting resubmitted
+static bool EvaluateTopLevel(std::unique_ptr<FunctionAST> _expr, double & _result) {
+	bool hoist = HoistLiterals && !_expr->getProto().hasAttribute(FunctionAttribute::Specialize);
+
+	// literals collected here are bound to the (possibly cached)
+	// kernel on every run
+	AstFingerprint fp {hoist};
+	_expr->fingerprint(fp);
+
+	// more literals than the interpreter has registers for, the
+	// expression keeps them baked in and is keyed that way too
+	if(hoist && fp.literals().size() > MaxRegisters) {
+		hoist = false;
+		fp = AstFingerprint {false};
+		_expr->fingerprint(fp);
+	}
+
+	const std::vector<double> & literals = fp.literals();
+
+	std::shared_ptr<CachedExpression> entry;
+	if(fp.valid()) {
+		if(auto hit = ExpressionCache.lookup(fp.bytes()))
+			entry = std::move(*hit);
+	}
+
+	if(!entry) {
+		entry = std::make_shared<CachedExpression>();
+
+		if(hoist) {
+			_expr->hoistLiterals(literals.size());
+			entry->m_Hoisted = true;
+		}
+
+		entry->m_Lowered = _expr->lower(*TheBytecode, entry->m_Code);
+		entry->m_Ast = std::move(_expr);
+
+		if(!entry->m_Lowered && !CompileExpression(*entry))
+			return false;
+
+		if(fp.valid())
+			ExpressionCache.insert(fp.bytes(), entry);
+	}
+
+	if(!entry->m_Native && ++entry->m_Runs == TierUpThreshold)
+		CompileExpression(*entry);
+
+	if(void * native = entry->m_Native) {
+		if(entry->m_Hoisted)
+			_result = reinterpret_cast<double (*)(const double *)>(native)(literals.data());
+		else
+			_result = reinterpret_cast<double (*)()>(native)();
+
+		return true;
+	}
+
+	if(Interpret(*TheBytecode, entry->m_Code, entry->m_Hoisted ? literals.data() : nullptr, _result))
+		return true;
+
+	LogError("> Interpreter bailed out");
+	return false;
+}
+
+static void HandleFuncDefinition() {
+	if(auto fn = ParseDefinition()) {
+		DefineFunction(std::move(fn));
+	} else {
+		// skip the token for error recovery
+		GetNextToken();
+	}
+}
+
+static void HandleExtern() {
+	if(auto proto = ParseExtern()) {
+		DeclareExtern(std::move(proto));
+	} else {
+		GetNextToken();
+	}
+}
+
+// Hot reload, a definition for a name that already exists replaces it
+// in place. Callers keep calling through the stub so they pick the new
+// version up by themselves, what has to be redone is anything that took
+// a copy of the old behaviour: bytecode and native code that folded a
+// call or inlined a body, effects inferred from the old body, memo
+// caches and cached top level expressions
+static void RedefineFunction(std::unique_ptr<FunctionAST> _fn) {
+	const std::string name = _fn->getName();
+
+	// callers were lowered and compiled against the old arity
+	if(_fn->getProto().getArgs().size() != FunctionDefinitions.at(name)->getProto().getArgs().size()) {
+		LogError("> Func can only be redefined with the same number of arguments");
+		return;
+	}
+
+	// everything that can observe the old body, and out of those the
+	// ones that baked part of it in and have to be lowered again
+	std::set<std::string> affected {name};
+	std::set<std::string> rebuild {name};
+	std::map<std::string, std::set<std::string>> depends;
+
+	{
+		std::lock_guard<std::mutex> lock {UsesMutex};
+		std::vector<std::string> work {name};
+
+		while(!work.empty()) {
+			const std::string callee = std::move(work.back());
+			work.pop_back();
+
+			auto it = Uses.find(callee);
+			if(it == Uses.end())
+				continue;
+
+			for(const auto * users : {&it->second.m_Callers, &it->second.m_Baked}) {
+				for(const std::string & user : *users) {
+					if(users == &it->second.m_Baked)
+						rebuild.insert(user);
+
+					if(affected.insert(user).second)
+						work.push_back(user);
+				}
+			}
+		}
+
+		for(const std::string & callee : rebuild) {
+			auto it = Uses.find(callee);
+			if(it == Uses.end())
+				continue;
+
+			for(const auto * users : {&it->second.m_Callers, &it->second.m_Baked})
+				for(const std::string & user : *users)
+					if(user != callee && rebuild.count(user))
+						depends[user].insert(callee);
+		}
+
+		// what gets rebuilt records its uses again as it's lowered
+		for(auto & [callee, uses] : Uses) {
+			for(const std::string & user : rebuild) {
+				uses.m_Callers.erase(user);
+				uses.m_Baked.erase(user);
+			}
+		}
+	}
+
+	// streamed definitions are gone, whatever they baked in stays
+	for(auto it = rebuild.begin(); it != rebuild.end(); ) {
+		if(FunctionDefinitions.count(*it)) {
+			++it;
+			continue;
+		}
+
+		if(RetiredFunctions.count(*it))
+			fprintf(stderr, "> Warning: %s was already compiled and retired, it keeps "
+					"the old %s\n", it->c_str(), name.c_str());
+
+		it = rebuild.erase(it);
+	}
+
+	// nothing that still has bytecode may run old native code while
+	// things are folded again, and no cache may answer with old results
+	std::map<std::string, void *> natives;
+	std::map<std::string, FunctionEffects> effects;
+
+	for(const std::string & user : affected) {
+		BytecodeFunction * bc = TheBytecode->lookup(user);
+		if(!bc)
+			continue;
+
+		if(bc->m_Native) {
+			natives[user] = bc->m_Native;
+			if(!bc->m_Code.empty())
+				bc->m_Native = nullptr;
+		}
+
+		if(bc->m_Memo)
+			bc->m_Memo->clear();
+
+		effects[user] = bc->m_Effects;
+	}
+
+	FunctionDefinitions[name] = std::move(_fn);
+	if(BytecodeFunction * bc = TheBytecode->lookup(name))
+		bc->m_Memo = nullptr;
+
+	// callees first, so calls into the rebuilt set fold against new code
+	std::vector<std::string> order;
+	std::set<std::string> visited;
+
+	std::function<void(const std::string &)> visit = [&](const std::string & _name) {
+		if(!visited.insert(_name).second)
+			return;
+
+		for(const std::string & callee : depends[_name])
+			visit(callee);
+
+		order.push_back(_name);
+	};
+
+	for(const std::string & fn : rebuild)
+		visit(fn);
+
+	std::vector<std::string> compile;
+
+	for(const std::string & fn : order) {
+		BytecodeFunction * bc = TheBytecode->lookup(fn);
+
+		// a failed lowering leaves the old code behind, which can't stay
+		if(!bc || !FunctionDefinitions.at(fn)->lower(*TheBytecode, *bc)) {
+			if(bc) {
+				bc->m_Code.clear();
+				bc->m_Constants.clear();
+
+				if(natives.count(fn))
+					bc->m_Native = natives.at(fn);
+			}
+
+			compile.push_back(fn);
+		} else if(natives.count(fn)) {
+			compile.push_back(fn);
+		}
+	}
+
+	for(const std::string & user : affected)
+		if(BytecodeFunction * bc = TheBytecode->lookup(user))
+			bc->m_EffectsKnown = false;
+
+	InferEffects(*TheBytecode);
+
+	// declarations of a callee carry its effects, so both a function
+	// whose effects changed and everything calling it are stale
+	{
+		std::lock_guard<std::mutex> lock {UsesMutex};
+
+		for(const auto & [user, before] : effects) {
+			if(TheBytecode->lookup(user)->m_Effects == before)
+				continue;
+
+			std::vector<std::string> stale {user};
+			if(auto it = Uses.find(user); it != Uses.end()) {
+				stale.insert(stale.end(), it->second.m_Callers.begin(), it->second.m_Callers.end());
+				stale.insert(stale.end(), it->second.m_Baked.begin(), it->second.m_Baked.end());
+			}
+
+			for(const std::string & fn : stale)
+				if(natives.count(fn) && FunctionDefinitions.count(fn))
+					compile.push_back(fn);
+		}
+	}
+
+	for(const std::string & user : affected) {
+		BytecodeFunction * bc = TheBytecode->lookup(user);
+
+		if(bc && bc->m_Memo && !(bc->m_Effects.m_ReadNone && bc->m_Effects.m_NoUnwind)) {
+			bc->m_Memo = nullptr;
+			fprintf(stderr, "> Warning: @memo on %s dropped, %s made it impure\n",
+					user.c_str(), name.c_str());
+		}
+	}
+
+	BytecodeFunction * bc = TheBytecode->lookup(name);
+	const FunctionAST & fn = *FunctionDefinitions.at(name);
+
+	if(bc && fn.getProto().hasAttribute(FunctionAttribute::Memo)) {
+		if(bc->m_Effects.m_ReadNone && bc->m_Effects.m_NoUnwind)
+			bc->m_Memo = GetMemoCache(name, bc->m_NumParams);
+
+		if(bc->m_Memo)
+			bc->m_Memo->clear();
+		else
+			fprintf(stderr, "> Warning: @memo ignored on %s, it's either impure or takes "
+					"more than %u arguments\n", name.c_str(), MaxMemoArgs);
+	}
+
+	std::sort(compile.begin(), compile.end());
+	compile.erase(std::unique(compile.begin(), compile.end()), compile.end());
+
+	// compiled here and not in the background. ModK code only ever runs
+	// on this thread (the server takes one request at a time), so no
+	// caller can be inside the old version while this runs, and the
+	// dependents' bytecode and the caches are rewritten around the
+	// compile where the next line of input mustn't see them half done.
+	// The jobs still run on the worker pool, and each stub is repointed
+	// with a single pointer store once its new version is linked
+	CompileAllForJIT(compile, true);
+
+	// the stubs stay where they were, only what's behind them moved
+	for(const auto & [user, native] : natives)
+		if(BytecodeFunction * user_bc = TheBytecode->lookup(user))
+			user_bc->m_Native = native;
+
+	for(const std::string & fn : compile) {
+		BytecodeFunction * fn_bc = TheBytecode->lookup(fn);
+
+		if(fn_bc && !fn_bc->callable())
+			fprintf(stderr, "> Error: %s can't be run anymore, it failed to compile "
+					"after %s was redefined\n", fn.c_str(), name.c_str());
+	}
+
+	ExpressionCache.clear();
+
+	fprintf(stderr, "> Redefined function: %s (%zu dependents rebuilt)\n",
+			name.c_str(), rebuild.size() - 1);
+}
+
+static void RunTopLevel(std::unique_ptr<FunctionAST> _expr) {
+	double result {};
+
+	// expressions only ever see fully compiled streamed definitions
+	FlushStream();
+	ReclaimRetiredVersions();
+
+	if(EvaluateTopLevel(std::move(_expr), result))
+		fprintf(stderr, "> Evaluated to %f\n", result);
+}
+
+static void HandleTopLevelExpression() {
+	if(auto expr = ParseTopLevelExpr()) {
+		RunTopLevel(std::move(expr));
+	} else {
+		GetNextToken();
+	}
+}
+
+#pragma endregion
+
+#pragma region RDP_LOOP
+
+static void repl() {
+	while(true) {
+		fprintf(stderr, "> Ready! ");
+
+		switch(CurrentToken) {
+			case Token::Token_EOF:
+				return;
+			
+			case ';':
+				GetNextToken();
+				break;
+
+			case Token::Token_func:
+				HandleFuncDefinition();
+				break;
+
+			case Token::Token_extern:
+				HandleExtern();
+				break;
+
+			default:
+				HandleTopLevelExpression();
+				break;
+		}
+	}
+}
+
+#pragma endregion
+
+#pragma region PIPELINE
+
+// Pipelined driver, the lexer, the parser and codegen each get their
+// own thread and hand work along through SPSC rings. Codegen stays on
+// the calling thread, optimization and machine code emission spread
+// over the JIT's compile threads behind it
+//
+// tokens cross over in batches so the ring's synchronisation is paid
+// once per batch rather than once per token
+using TokenBatch = std::vector<LexedToken>;
+static constexpr size_t TokenBatchSize = 512;
+
+// one parsed top level item, either a definition, an expression or
+// an extern declaration. Nothing in it at all marks the end of input
+struct ParsedItem {
+	std::unique_ptr<FunctionAST> m_Ast;
+	bool m_TopLevel {false};
+
+	std::unique_ptr<PrototypeAST> m_Extern;
+};
+
+class RingTokenSource : public TokenSource {
+	SpscRing<TokenBatch> & m_Ring;
+	TokenBatch m_Batch;
+	size_t m_Pos {0};
+
+	public:
+		explicit RingTokenSource(SpscRing<TokenBatch> & _ring) : m_Ring {_ring} {}
+
+		virtual int next() override {
+			// the lexer stops after EOF, so keep handing that out
+			// rather than waiting on a batch that never comes
+			if(m_Pos == m_Batch.size() && !m_Batch.empty()
+					&& m_Batch.back().m_Kind == Token::Token_EOF)
+				return Token::Token_EOF;
+
+			while(m_Pos == m_Batch.size()) {
+				m_Batch = m_Ring.pop();
+				m_Pos = 0;
+			}
+
+			return RestoreToken(std::move(m_Batch[m_Pos++]));
+		}
+};
+
+// _prelexed is set when the input was already lexed in parallel, in
+// which case this stage only has to chop it into batches
+static void LexerStage(SpscRing<TokenBatch> & _out, const std::vector<LexedToken> * _prelexed) {
+	if(_prelexed) {
+		for(size_t i {0}; i < _prelexed->size(); i += TokenBatchSize) {
+			const auto first = _prelexed->begin() + i;
+			_out.push(TokenBatch(first, first + std::min(TokenBatchSize, _prelexed->size() - i)));
+		}
+
+		return;
+	}
+
+	TokenBatch batch;
+	batch.reserve(TokenBatchSize);
+
+	while(true) {
+		int tok = GetToken();
+		batch.push_back(CaptureToken(tok));
+
+		if(tok != Token::Token_EOF && batch.size() != TokenBatchSize)
+			continue;
+
+		_out.push(std::move(batch));
+		if(tok == Token::Token_EOF)
+			return;
+
+		batch = {};
+		batch.reserve(TokenBatchSize);
+	}
+}
+
+// the repl loop minus the prompts and evaluation, parses everything
+// _source has and hands each item to _emit in order
+template<typename Emit>
+static void ParseItems(TokenSource & _source, Emit && _emit) {
+	ActiveTokenSource = &_source;
+	GetNextToken();
+
+	while(CurrentToken != Token::Token_EOF) {
+		switch(CurrentToken) {
+			case ';':
+				GetNextToken();
+				break;
+
+			case Token::Token_func:
+				if(auto fn = ParseDefinition())
+					_emit(ParsedItem {std::move(fn), false, nullptr});
+				else
+					GetNextToken();
+				break;
+
+			case Token::Token_extern:
+				if(auto proto = ParseExtern())
+					_emit(ParsedItem {nullptr, false, std::move(proto)});
+				else
+					GetNextToken();
+				break;
+
+			default:
+				if(auto expr = ParseTopLevelExpr())
+					_emit(ParsedItem {std::move(expr), true, nullptr});
+				else
+					GetNextToken();
+				break;
+		}
+	}
+
+	ActiveTokenSource = nullptr;
+}
+
+static void ParserStage(SpscRing<TokenBatch> & _in, SpscRing<ParsedItem> & _out) {
+	RingTokenSource source {_in};
+
+	ParseItems(source, [&](ParsedItem && _item) { _out.push(std::move(_item)); });
+	_out.push({});
+}
+
+static void RunPipeline(const std::vector<LexedToken> * _prelexed) {
+	SpscRing<TokenBatch> tokens {64};
+	SpscRing<ParsedItem> items {256};
+
+	std::thread lexer {LexerStage, std::ref(tokens), _prelexed};
+	std::thread parser {ParserStage, std::ref(tokens), std::ref(items)};
+
+	while(true) {
+		ParsedItem item = items.pop();
+		if(!item.m_Ast && !item.m_Extern)
+			break;
+
+		if(item.m_Extern)
+			DeclareExtern(std::move(item.m_Extern));
+		else if(item.m_TopLevel)
+			RunTopLevel(std::move(item.m_Ast));
+		else
+			DefineFunction(std::move(item.m_Ast));
+	}
+
+	lexer.join();
+	parser.join();
+}
+
+#pragma endregion
+
+#pragma region PARALLEL_PARSE
+
+// Parallel parsing of input that was lexed up front. A definition's
+// body is a single expression that can't contain `func` or `;`, so a
+// quick scan over the tokens for `func` finds where every definition
+// starts without parsing anything. Each span between two of those
+// (the definition plus any top level expressions after it) parses on
+// its own, and parsing only reads BinOpPrecedence and the attribute
+// names, so spans can go to different threads as is
+//
+// every worker owns the ASTs for its spans until the merge, which
+// runs them through DefineFunction/RunTopLevel in source order so the
+// symbol table (FunctionDefinitions and the bytecode module) ends up
+// exactly as the serial parse would leave it
+static std::vector<size_t> FindDefinitionBoundaries(const std::vector<LexedToken> & _tokens) {
+	std::vector<size_t> boundaries {0};
+
+	for(size_t i {1}; i < _tokens.size(); ++i) {
+		if(_tokens[i].m_Kind == Token::Token_func || _tokens[i].m_Kind == Token::Token_extern)
+			boundaries.push_back(i);
+	}
+
+	boundaries.push_back(_tokens.size());
+	return boundaries;
+}
+
+static void RunParallelParse(const std::vector<LexedToken> & _tokens, const unsigned _threads) {
+	const std::vector<size_t> boundaries = FindDefinitionBoundaries(_tokens);
+
+	// definitions vary a lot in size, so cut the input into a few
+	// jobs per thread of about the same number of tokens and let the
+	// threads pull them rather than handing each thread one block
+	const size_t target = std::max<size_t>(1, _tokens.size() / (_threads * 8));
+	std::vector<std::pair<size_t, size_t>> jobs;
+
+	for(size_t i {0}, start {0}; i + 1 < boundaries.size(); ++i) {
+		const size_t end = boundaries[i + 1];
+
+		if(end - start >= target || i + 2 == boundaries.size()) {
+			jobs.emplace_back(start, end);
+			start = end;
+		}
+	}
+
+	std::vector<std::vector<ParsedItem>> results(jobs.size());
+	std::atomic<size_t> next_job {0};
+
+	auto worker = [&] {
+		for(size_t job; (job = next_job.fetch_add(1, std::memory_order_relaxed)) < jobs.size(); ) {
+			VectorTokenSource source {_tokens.data() + jobs[job].first, _tokens.data() + jobs[job].second};
+
+			ParseItems(source, [&](ParsedItem && _item) {
+				results[job].push_back(std::move(_item));
+			});
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned i {1}; i < std::min<size_t>(_threads, jobs.size()); ++i)
+		workers.emplace_back(worker);
+
+	worker();
+
+	for(auto & thread : workers)
+		thread.join();
+
+	// with EagerJIT the definitions between two top level expressions
+	// are compiled as one batch (on CompileJobs threads) before the
+	// expression runs
+	std::vector<std::string> batch;
+
+	auto flush = [&] {
+		if(!batch.empty())
+			CompileAllForJIT(batch);
+
+		batch.clear();
+	};
+
+	for(auto & items : results) {
+		for(auto & item : items) {
+			if(item.m_Extern) {
+				DeclareExtern(std::move(item.m_Extern));
+			} else if(item.m_TopLevel) {
+				flush();
+				RunTopLevel(std::move(item.m_Ast));
+			} else {
+				if(EagerJIT)
+					batch.push_back(item.m_Ast->getName());
+
+				DefineFunction(std::move(item.m_Ast));
+			}
+		}
+	}
+
+	flush();
+}
+
+#pragma endregion
+
+#pragma region AOT
+
+// Ahead of time output, every definition is generated into one module
+// which is split into CompileJobs partitions the way llvm::SplitModule
+// sees fit (callers and callees stay together where it can manage).
+// A module can't leave its context, so every partition goes through
+// bitcode into a context of its own, after which it's optimized and
+// emitted on whichever worker picks it up
+//
+// with _only just those definitions are written out, whatever they call
+// outside of it is left for the linker like an extern would be
+static bool EmitObjectFiles(const std::string & _prefix, const std::set<std::string> * _only = nullptr) {
+	struct PartitionJob {
+		SmallString<0> m_Bitcode;
+		std::string m_Path {};
+		std::unique_ptr<LLVMContext> m_Context;
+		std::unique_ptr<Module> m_Module;
+		bool m_Written {false};
+	};
+
+	InitializeModule();
+	if(auto err = PrepareObjectModule(*TheModule)) {
+		LogError(toString(std::move(err)).c_str());
+		return false;
+	}
+
+	for(const auto & [name, fn] : FunctionDefinitions) {
+		if(_only && !_only->count(name))
+			continue;
+
+		if(!fn->codegen())
+			fprintf(stderr, "> Warning: %s left out of the object files\n", name.c_str());
+	}
+
+	// hottest first, each partition's sections then start with what runs
+	// the most and stay in that order when the linker groups them
+	std::vector<Function *> order;
+	for(Function & f : *TheModule) {
+		if(!f.isDeclaration())
+			order.push_back(&f);
+	}
+
+	auto rank = [](const Function * _f) {
+		auto prefix = _f->getSectionPrefix();
+		return !prefix ? 1 : *prefix == "hot" ? 0 : 2;
+	};
+
+	std::stable_sort(order.begin(), order.end(), [&](const Function * _a, const Function * _b) {
+		if(rank(_a) != rank(_b))
+			return rank(_a) < rank(_b);
+
+		return ProfileCount(_a->getName().str()) > ProfileCount(_b->getName().str());
+	});
+
+	for(Function * f : order) {
+		f->removeFromParent();
+		TheModule->getFunctionList().push_back(f);
+	}
+
+	std::vector<std::unique_ptr<PartitionJob>> partitions;
+
+	SplitModule(*TheModule, JobCount(), [&](std::unique_ptr<Module> _part) {
+		auto partition = std::make_unique<PartitionJob>();
+		partition->m_Path = _prefix + "." + std::to_string(partitions.size()) + ".o";
+
+		raw_svector_ostream os {partition->m_Bitcode};
+		WriteBitcodeToFile(*_part, os);
+
+		partitions.push_back(std::move(partition));
+	});
+
+	JobScheduler scheduler {JobCount()};
+
+	for(auto & partition : partitions) {
+		PartitionJob & part = *partition;
+
+		auto optimize = scheduler.add("optimize " + part.m_Path, [&part] {
+			part.m_Context = std::make_unique<LLVMContext>();
+			part.m_Context->setDiscardValueNames(FastCompile);
+
+			auto mod = parseBitcodeFile(MemoryBufferRef(part.m_Bitcode.str(), part.m_Path),
+					*part.m_Context);
+			if(!mod) {
+				LogError(toString(mod.takeError()).c_str());
+				return;
+			}
+
+			part.m_Module = std::move(*mod);
+
+			if(auto target = GetObjectTargetMachine())
+				OptimizeModule(*part.m_Module, *target);
+			else
+				LogError(toString(target.takeError()).c_str());
+		});
+
+		auto emit = scheduler.add("emit " + part.m_Path, [&part] {
+			if(!part.m_Module)
+				return;
+
+			auto object = EmitObjectFile(*part.m_Module);
+			part.m_Module.reset();
+			part.m_Context.reset();
+
+			if(!object) {
+				LogError(toString(object.takeError()).c_str());
+				return;
+			}
+
+			std::error_code ec;
+			raw_fd_ostream out {part.m_Path, ec};
+			if(ec) {
+				LogError(ec.message().c_str());
+				return;
+			}
+
+			out << (*object)->getBuffer();
+			part.m_Written = true;
+		});
+
+		scheduler.depends(emit, optimize);
+	}
+
+	scheduler.run();
+
+	if(ReportJobs)
+		scheduler.report(stderr);
+
+	bool ok {true};
+	for(const auto & partition : partitions) {
+		if(partition->m_Written)
+			fprintf(stderr, "> Wrote %s\n", partition->m_Path.c_str());
+		else
+			ok = false;
+	}
+
+	return ok;
+}
+
+#pragma endregion
+
+#pragma region SERVER
+
+// One request to the compile server. Nothing is reset in between, so
+// definitions, externs, the bytecode and everything already compiled
+// carry over to later requests, a definition sent again unchanged is
+// only parsed, and a changed one replaces the old one (the server
+// always runs with HotReload). An object request writes out only the
+// definitions it carries itself
+static int ServeRequest(const ServerRequest & _request) {
+	const bool emit = _request.m_Kind == ServerRequest::Kind::EmitObject;
+
+	// externs aren't looked up and @memo stays off while it's set
+	if(emit)
+		ObjectOutput = _request.m_Argument;
+
+	const std::vector<LexedToken> tokens = LexParallel(_request.m_Source, JobCount());
+	VectorTokenSource source {tokens};
+	std::set<std::string> defined;
+
+	ParseItems(source, [&](ParsedItem && _item) {
+		if(_item.m_Extern) {
+			DeclareExtern(std::move(_item.m_Extern));
+		} else if(_item.m_TopLevel) {
+			if(emit)
+				fprintf(stderr, "> Warning: top level expressions are ignored with --emit-obj\n");
+			else
+				RunTopLevel(std::move(_item.m_Ast));
+		} else {
+			defined.insert(_item.m_Ast->getName());
+			DefineFunction(std::move(_item.m_Ast));
+		}
+	});
+
+	FlushStream();
+
+	int status {0};
+	if(emit) {
+		status = EmitObjectFiles(_request.m_Argument, &defined) ? 0 : 1;
+		ObjectOutput.clear();
+	}
+
+	return status;
+}
+
+#pragma endregion
+
+#pragma region CODEGEN_IMPL
+
+Value * NumberLiteralAST::codegen() const {
+	if(HoistedLiterals) {
+		Type * dbl = Type::getDoubleTy(*TheContext);
+		Value * slot = Builder->CreateConstInBoundsGEP1_32(dbl, HoistedLiterals,
+				NextHoistedLiteral++, "litptr");
+
+		return Builder->CreateLoad(dbl, slot, "lit");
+	}
+
+	return ConstantFP::get(*TheContext, APFloat(m_Value));
+}
+
+Value * StringLiteralAST::codegen() const {
+	return LogErrorV("> String literals aren't supported yet");
+}
+
+Value * VariableExpressionAST::codegen() const {
+	auto it = NamedValues.find(m_Name);
+	if(it == NamedValues.end())
+		return LogErrorV("> Unkown Variable name");
+
+	return it->second;
+}
+
+Value * ExpressionAST::codegenCondition() const {
+	Value * v = codegen();
+	if(!v)
+		return nullptr;
+
+	return Builder->CreateFCmpUNE(v, ConstantFP::get(*TheContext, APFloat(0.0)), "tobool");
+}
+
+bool BinaryExpressionAST::isComparison() const {
+	switch(m_Operator) {
+		case '<':
+		case '>':
+		case Token::Token_le:
+		case Token::Token_ge:
+		case Token::Token_eq:
+		case Token::Token_ne:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+bool BinaryExpressionAST::isLogical() const {
+	return m_Operator == Token::Token_and || m_Operator == Token::Token_or;
+}
+
+// a product that was just built with contraction allowed and that
+// nothing else uses yet, so it can be folded into its sum
+static BinaryOperator * ContractibleProduct(Value * _v) {
+	if(!Builder->getFastMathFlags().allowContract())
+		return nullptr;
+
+	auto * mul = dyn_cast<BinaryOperator>(_v);
+	if(!mul || mul->getOpcode() != Instruction::FMul || !mul->use_empty() || !mul->hasAllowContract())
+		return nullptr;
+
+	return mul;
+}
+
+// replaces _mul with llvm.fmuladd, the backend turns that into an FMA
+// where the target has one and splits it back up where it doesn't
+static Value * FuseMultiplyAdd(BinaryOperator * _mul, Value * _addend, const bool _negate_product) {
+	Value * a = _mul->getOperand(0);
+	Value * b = _mul->getOperand(1);
+	_mul->eraseFromParent();
+
+	if(_negate_product)
+		a = Builder->CreateFNeg(a);
+
+	return Builder->CreateIntrinsic(Intrinsic::fmuladd, {Builder->getDoubleTy()},
+			{a, b, _addend}, nullptr, "fmatmp");
+}
+
+Value * BinaryExpressionAST::codegen() const {
+	// only widened here, where the result is used as a number
+	if(isComparison() || isLogical()) {
+		Value * cond = codegenCondition();
+		if(!cond)
+			return nullptr;
+
+		return Builder->CreateUIToFP(cond, Type::getDoubleTy(*TheContext), "booltmp");
+	}
+
+	Value* L = LHS->codegen();
+	Value* R = RHS->codegen();
+
+	if(!L || !R) return nullptr;
+
+	switch(m_Operator) {
+		case '+':
+			if(BinaryOperator * mul = ContractibleProduct(L))
+				return FuseMultiplyAdd(mul, R, false);
+
+			if(BinaryOperator * mul = ContractibleProduct(R))
+				return FuseMultiplyAdd(mul, L, false);
+
+			return Builder->CreateFAdd(L, R, "addtmp");
+
+		case '-':
+			if(BinaryOperator * mul = ContractibleProduct(L))
+				return FuseMultiplyAdd(mul, Builder->CreateFNeg(R), false);
+
+			if(BinaryOperator * mul = ContractibleProduct(R))
+				return FuseMultiplyAdd(mul, L, true);
+
+			return Builder->CreateFSub(L, R, "subtmp");
+
+		case '*':
+			return Builder->CreateFMul(L, R, "multmp");
+
+		default:
+			return LogErrorV("> Invalid Binary Operator");
+	}
+}
+
+// the same weights clang gives __builtin_expect, nullptr without a hint
+static MDNode * BranchWeights(const BranchHint _hint) {
+	constexpr uint32_t Taken = 2000;
+	constexpr uint32_t NotTaken = 1;
+
+	if(_hint == BranchHint::None)
+		return nullptr;
+
+	MDBuilder md {*TheContext};
+	return _hint == BranchHint::Likely ? md.createBranchWeights(Taken, NotTaken)
+		: md.createBranchWeights(NotTaken, Taken);
+}
+
+Value * BinaryExpressionAST::codegenCondition() const {
+	if(isLogical()) {
+		// the RHS only runs if the LHS didn't already decide it, which
+		// is a branch around it and a phi of whoever got to the end
+		const bool is_and = m_Operator == Token::Token_and;
+
+		Value * L = LHS->codegenCondition();
+		if(!L)
+			return nullptr;
+
+		BasicBlock * lhs_end = Builder->GetInsertBlock();
+		Function * fn = lhs_end->getParent();
+
+		BasicBlock * rhs_bb = BasicBlock::Create(*TheContext, is_and ? "and.rhs" : "or.rhs", fn);
+		BasicBlock * merge_bb = BasicBlock::Create(*TheContext, is_and ? "and.end" : "or.end", fn);
+
+		// weights go by the condition, not by which side is the rhs
+		MDNode * weights = BranchWeights(LHS->branchHint());
+
+		if(is_and)
+			Builder->CreateCondBr(L, rhs_bb, merge_bb, weights);
+		else
+			Builder->CreateCondBr(L, merge_bb, rhs_bb, weights);
+
+		Builder->SetInsertPoint(rhs_bb);
+		Value * R = RHS->codegenCondition();
+		if(!R)
+			return nullptr;
+
+		BasicBlock * rhs_end = Builder->GetInsertBlock();
+		Builder->CreateBr(merge_bb);
+
+		Builder->SetInsertPoint(merge_bb);
+		PHINode * phi = Builder->CreatePHI(Builder->getInt1Ty(), 2, is_and ? "andtmp" : "ortmp");
+		phi->addIncoming(Builder->getInt1(!is_and), lhs_end);
+		phi->addIncoming(R, rhs_end);
+
+		return phi;
+	}
+
+	if(!isComparison())
+		return ExpressionAST::codegenCondition();
+
+	Value* L = LHS->codegen();
+	Value* R = RHS->codegen();
+
+	if(!L || !R) return nullptr;
+
+	// ordered like C, so anything against a NaN is false except !=
+	switch(m_Operator) {
+		case '<':
+			return Builder->CreateFCmpOLT(L, R, "cmptmp");
+
+		case '>':
+			return Builder->CreateFCmpOGT(L, R, "cmptmp");
+
+		case Token::Token_le:
+			return Builder->CreateFCmpOLE(L, R, "cmptmp");
+
+		case Token::Token_ge:
+			return Builder->CreateFCmpOGE(L, R, "cmptmp");
+
+		case Token::Token_eq:
+			return Builder->CreateFCmpOEQ(L, R, "cmptmp");
+
+		default:
+			return Builder->CreateFCmpUNE(L, R, "cmptmp");
+	}
+}
+
+Value * IfExpressionAST::codegen() const {
+	Value * cond = m_Cond->codegenCondition();
+	if(!cond)
+		return nullptr;
+
+	// nothing to skip over, so no reason to branch
+	if(m_Then->isTrivial() && m_Else->isTrivial()) {
+		Value * then = m_Then->codegen();
+		Value * otherwise = m_Else->codegen();
+		if(!then || !otherwise)
+			return nullptr;
+
+		// CodeGenPrepare reads these when deciding to turn it back into a branch
+		Value * select = Builder->CreateSelect(cond, then, otherwise, "iftmp");
+		if(MDNode * weights = BranchWeights(m_Cond->branchHint()); weights && isa<SelectInst>(select))
+			cast<SelectInst>(select)->setMetadata(LLVMContext::MD_prof, weights);
+
+		return select;
+	}
+
+	Function * fn = Builder->GetInsertBlock()->getParent();
+
+	BasicBlock * then_bb = BasicBlock::Create(*TheContext, "then", fn);
+	BasicBlock * else_bb = BasicBlock::Create(*TheContext, "else", fn);
+	BasicBlock * merge_bb = BasicBlock::Create(*TheContext, "ifcont", fn);
+
+	Builder->CreateCondBr(cond, then_bb, else_bb, BranchWeights(m_Cond->branchHint()));
+
+	Builder->SetInsertPoint(then_bb);
+	Value * then = m_Then->codegen();
+	if(!then)
+		return nullptr;
+
+	then_bb = Builder->GetInsertBlock();
+	Builder->CreateBr(merge_bb);
+
+	Builder->SetInsertPoint(else_bb);
+	Value * otherwise = m_Else->codegen();
+	if(!otherwise)
+		return nullptr;
+
+	else_bb = Builder->GetInsertBlock();
+	Builder->CreateBr(merge_bb);
+
+	Builder->SetInsertPoint(merge_bb);
+	PHINode * phi = Builder->CreatePHI(Type::getDoubleTy(*TheContext), 2, "iftmp");
+	phi->addIncoming(then, then_bb);
+	phi->addIncoming(otherwise, else_bb);
+
+	return phi;
+}
+
+Value * FPModeExpressionAST::codegen() const {
+	const FPMode outer = CurrentFPMode;
+
+	SetFPMode(m_Mode);
+	Value * v = m_Body->codegen();
+	SetFPMode(outer);
+
+	return v;
+}
+
+Value * FPModeExpressionAST::codegenCondition() const {
+	const FPMode outer = CurrentFPMode;
+
+	SetFPMode(m_Mode);
+	Value * v = m_Body->codegenCondition();
+	SetFPMode(outer);
+
+	return v;
+}
+
+// every function is compiled into a module of its own, so an @inline
+// callee's body is copied into the caller's as available_externally.
+// The inliner can use it but the copy itself is never emitted, the
+// real definition is still the one the JIT already has
+static Function * ImportInlineBody(const FunctionAST & _fn) {
+	// memo wrappers bake in their cache, not something to duplicate
+	if(const BytecodeFunction * bc = TheBytecode->lookup(_fn.getName()); bc && bc->m_Memo)
+		return nullptr;
+
+	// the body is generated in the middle of the caller's
+	const IRBuilderBase::InsertPoint ip = Builder->saveIP();
+	std::map<std::string, Value *> named_values = std::move(NamedValues);
+	Value * hoisted_literals = HoistedLiterals;
+	const unsigned next_hoisted = NextHoistedLiteral;
+	const FPMode fp_mode = CurrentFPMode;
+
+	Function * f = _fn.codegen();
+	if(f)
+		f->setLinkage(GlobalValue::AvailableExternallyLinkage);
+
+	Builder->restoreIP(ip);
+	NamedValues = std::move(named_values);
+	HoistedLiterals = hoisted_literals;
+	NextHoistedLiteral = next_hoisted;
+	SetFPMode(fp_mode);
+
+	return f;
+}
+
+// finds _name in the module being built, declaring it there if its
+// definition was compiled into one that's already in the JIT
+static Function * getFunction(const std::string & _name) {
+	if(Function * f = TheModule->getFunction(_name))
+		return f;
+
+	if(auto it = FunctionDefinitions.find(_name); it != FunctionDefinitions.end()) {
+		if(it->second->getProto().hasAttribute(FunctionAttribute::Inline)) {
+			const std::string user = CodegenUser();
+
+			if(Function * f = ImportInlineBody(*it->second)) {
+				RecordUse(_name, user, true);
+				return f;
+			}
+		}
+
+		return it->second->getProto().codegen();
+	}
+
+	if(auto it = RetiredFunctions.find(_name); it != RetiredFunctions.end()) {
+		PrototypeAST proto {_name, std::vector<std::string>(it->second.m_NumArgs)};
+		proto.setAttributes(it->second.m_Attributes);
+		return proto.codegen();
+	}
+
+	if(auto it = ExternFunctions.find(_name); it != ExternFunctions.end())
+		return it->second->codegen();
+
+	return nullptr;
+}
+
+// runs calls whose arguments all folded to constants through the
+// interpreter and substitutes the result, anything impure, too
+// expensive or not lowered to bytecode is left as a runtime call
+static Value * ConstEvalCall(const std::string & _callee, const std::vector<Value *> & _args) {
+	const BytecodeFunction * fn = TheBytecode->lookup(_callee);
+	if(!fn || fn->m_NumParams != _args.size())
+		return nullptr;
+
+	std::vector<double> args;
+	for(Value * arg : _args) {
+		auto * c = dyn_cast<ConstantFP>(arg);
+		if(!c)
+			return nullptr;
+
+		args.push_back(c->getValueAPF().convertToDouble());
+	}
+
+	double result {};
+	if(!Evaluate(*TheBytecode, *fn, args.data(), ConstEvalBudget, result))
+		return nullptr;
+
+	return ConstantFP::get(*TheContext, APFloat(result));
+}
+
+// LLVM type an extern passes _type as, see ParseExternType
+static Type * ExternType(const Types _type) {
+	switch(_type) {
+		case Types::I32:
+		case Types::U32:
+			return Builder->getInt32Ty();
+
+		case Types::F32:
+			return Builder->getFloatTy();
+
+		case Types::CHAR:
+		case Types::UCHAR:
+			return Builder->getInt8Ty();
+
+		case Types::BOOL:
+			return Builder->getInt1Ty();
+
+		default:
+			return Builder->getDoubleTy();
+	}
+}
+
+// the extension the C ABI expects on narrow integers, none for the rest
+static Attribute::AttrKind ExternExtension(const Types _type) {
+	switch(_type) {
+		case Types::CHAR:
+			return Attribute::SExt;
+
+		case Types::UCHAR:
+		case Types::BOOL:
+			return Attribute::ZExt;
+
+		default:
+			return Attribute::None;
+	}
+}
+
+static Value * DoubleToExtern(Value * _v, const Types _type) {
+	switch(_type) {
+		case Types::I32:
+		case Types::CHAR:
+			return Builder->CreateFPToSI(_v, ExternType(_type), "cvttmp");
+
+		case Types::U32:
+		case Types::UCHAR:
+			return Builder->CreateFPToUI(_v, ExternType(_type), "cvttmp");
+
+		case Types::F32:
+			return Builder->CreateFPTrunc(_v, ExternType(_type), "cvttmp");
+
+		case Types::BOOL:
+			return Builder->CreateFCmpUNE(_v, ConstantFP::get(*TheContext, APFloat(0.0)), "cvttmp");
+
+		default:
+			return _v;
+	}
+}
+
+static Value * ExternToDouble(Value * _v, const Types _type) {
+	switch(_type) {
+		case Types::I32:
+		case Types::CHAR:
+			return Builder->CreateSIToFP(_v, Builder->getDoubleTy(), "cvttmp");
+
+		case Types::U32:
+		case Types::UCHAR:
+		case Types::BOOL:
+			return Builder->CreateUIToFP(_v, Builder->getDoubleTy(), "cvttmp");
+
+		case Types::F32:
+			return Builder->CreateFPExt(_v, Builder->getDoubleTy(), "cvttmp");
+
+		default:
+			return _v;
+	}
+}
+
+// a plain call to the host symbol, any conversion to and from the C
+// types is a single instruction on either side of it
+static Value * CodegenExternCall(const PrototypeAST & _proto, Function * _callee, std::vector<Value *> & _args) {
+	const std::vector<Types> & arg_types = _proto.getArgTypes();
+
+	for(size_t i {0}, e = _args.size(); i != e; ++i)
+		_args[i] = DoubleToExtern(_args[i], arg_types[i]);
+
+	return ExternToDouble(Builder->CreateCall(_callee, _args, "externtmp"), _proto.getReturnType());
+}
+
+// builtins become intrinsic calls, folded here when every argument is
+// constant so the JIT and the interpreter agree on the result
+static Value * CodegenBuiltinCall(const int _builtin, const std::vector<Value *> & _args) {
+	const BuiltinFunction & builtin = Builtins[_builtin];
+
+	double constant_args[3] {};
+	bool constant {true};
+
+	for(size_t i {0}, e = _args.size(); i != e && constant; ++i) {
+		if(auto * c = dyn_cast<ConstantFP>(_args[i]))
+			constant_args[i] = c->getValueAPF().convertToDouble();
+		else
+			constant = false;
+	}
+
+	if(constant)
+		return ConstantFP::get(*TheContext, APFloat(builtin.m_Eval(constant_args)));
+
+	Function * intrinsic = Intrinsic::getDeclaration(TheModule.get(),
+			static_cast<Intrinsic::ID>(builtin.m_Intrinsic), {Type::getDoubleTy(*TheContext)});
+
+	return Builder->CreateCall(intrinsic, _args, "builtintmp");
+}
+
+Value * FuncCallAST::codegen() const {
+	Function * callee = getFunction(m_Caller);
+	int builtin = callee ? -1 : FindBuiltin(m_Caller, m_Args.size());
+
+	if(!callee && builtin < 0)
+		return LogErrorV("> Unknown Function Referenced");
+
+	if(callee && callee->arg_size() != m_Args.size())
 		return LogErrorV("> Incorrect Arguments passed");
 
-	std::vector<Value *> args_v;
+	std::vector<Value *> args_v;
+	for(size_t i {0}, e = m_Args.size(); i != e; ++i) {
+		args_v.push_back(m_Args[i]->codegen());
+
+		if(!args_v.back())
+			return nullptr;
+	}
+
+	if(builtin >= 0)
+		return CodegenBuiltinCall(builtin, args_v);
+
+	if(auto it = ExternFunctions.find(m_Caller); it != ExternFunctions.end())
+		return CodegenExternCall(*it->second, callee, args_v);
+
+	if(Value * folded = ConstEvalCall(m_Caller, args_v)) {
+		RecordUse(m_Caller, CodegenUser(), true);
+		return folded;
+	}
+
+	RecordUse(m_Caller, CodegenUser(), false);
+	return Builder->CreateCall(callee, args_v, "calltmp");
+}
+
+// the cache is memory LLVM can't see, so neither the wrapper, the
+// body it calls back into nor declarations of it elsewhere get to
+// claim they don't touch any. It's also guarded by atomics
+static void MarkTouchesCacheOnly(Function * _fn) {
+	_fn->removeFnAttr(Attribute::ReadNone);
+	_fn->removeFnAttr(Attribute::NoSync);
+	_fn->removeFnAttr(Attribute::Speculatable);
+	_fn->setOnlyAccessesInaccessibleMemory();
+}
+
+Function* PrototypeAST::codegen() const {
+	std::vector<Type *> Doubles(m_Args.size(), Type::getDoubleTy(*TheContext));
+
+	if(m_Extern) {
+		const std::vector<Types> & arg_types = getArgTypes();
+		for(size_t i {0}, e = m_Args.size(); i != e; ++i)
+			Doubles[i] = ExternType(arg_types[i]);
+	}
+
+	FunctionType* ft = FunctionType::get(
+		m_Extern ? ExternType(m_ReturnType) : Type::getDoubleTy(*TheContext), Doubles, false
+	);
+
+	Function* f = Function::Create(
+		ft, Function::ExternalLinkage, m_Name, TheModule.get()
+	);
+
+	if(m_Extern) {
+		const std::vector<Types> & arg_types = getArgTypes();
+		for(size_t i {0}, e = m_Args.size(); i != e; ++i) {
+			if(Attribute::AttrKind ext = ExternExtension(arg_types[i]); ext != Attribute::None)
+				f->addParamAttr(i, ext);
+		}
+
+		if(Attribute::AttrKind ext = ExternExtension(m_ReturnType); ext != Attribute::None)
+			f->addRetAttr(ext);
+	}
+
+	size_t idx {0};
+
+	for(auto & Arg : f->args())
+		Arg.setName(m_Args[idx++]);
+
+	// declarations get them too, that's what lets callers in other
+	// modules CSE and hoist calls to our little math helpers
+	if(const BytecodeFunction * bc = TheBytecode->lookup(m_Name)) {
+		ApplyEffects(*f, bc->m_Effects);
+
+		// what's called is the memo wrapper, see EmitMemoWrapper
+		if(bc->m_Memo && ObjectOutput.empty())
+			MarkTouchesCacheOnly(f);
+	}
+
+	// like effects these matter most on declarations, a cold callee is
+	// what marks the path to a call as unlikely
+	if(hasAttribute(FunctionAttribute::Hot))
+		f->addFnAttr(Attribute::Hot);
+
+	if(hasAttribute(FunctionAttribute::Cold)) {
+		f->addFnAttr(Attribute::Cold);
+		f->addFnAttr(Attribute::OptimizeForSize);
+	}
+
+	if(hasAttribute(FunctionAttribute::Inline))
+		f->addFnAttr(Attribute::AlwaysInline);
+
+	if(hasAttribute(FunctionAttribute::NoInline))
+		f->addFnAttr(Attribute::NoInline);
+
+	return f;
+}
+
+// renames _body out of the way and puts a wrapper that checks _cache
+// under its name, recursive calls in the body are pointed at the
+// wrapper as well so every level of the recursion is cached
+static Function * EmitMemoWrapper(Function * _body, MemoCache * _cache) {
+	LLVMContext & ctx = *TheContext;
+	const std::string name = _body->getName().str();
+
+	_body->setName(name + ".memo");
+	_body->setLinkage(Function::InternalLinkage);
+
+	Function * wrapper = Function::Create(_body->getFunctionType(), Function::ExternalLinkage,
+			name, TheModule.get());
+	_body->replaceAllUsesWith(wrapper);
+
+	if(auto prefix = _body->getSectionPrefix())
+		wrapper->setSectionPrefix(*prefix);
+
+	MarkTouchesCacheOnly(_body);
+	MarkTouchesCacheOnly(wrapper);
+	if(_body->doesNotThrow())
+		wrapper->setDoesNotThrow();
+
+	Type * dbl = Type::getDoubleTy(ctx);
+	Type * ptr = Type::getInt8PtrTy(ctx);
+	Type * intptr = Type::getInt64Ty(ctx);
+
+	FunctionType * lookup_ty = FunctionType::get(Type::getInt32Ty(ctx),
+			{ptr, dbl->getPointerTo(), dbl->getPointerTo()}, false);
+	FunctionType * store_ty = FunctionType::get(Type::getVoidTy(ctx),
+			{ptr, dbl->getPointerTo(), dbl}, false);
+
+	// same process, so the runtime and the cache are just addresses
+	Constant * cache = ConstantExpr::getIntToPtr(
+			ConstantInt::get(intptr, reinterpret_cast<uintptr_t>(_cache)), ptr);
+	Constant * lookup_fn = ConstantExpr::getIntToPtr(
+			ConstantInt::get(intptr, reinterpret_cast<uintptr_t>(&modk_memo_lookup)),
+			lookup_ty->getPointerTo());
+	Constant * store_fn = ConstantExpr::getIntToPtr(
+			ConstantInt::get(intptr, reinterpret_cast<uintptr_t>(&modk_memo_store)),
+			store_ty->getPointerTo());
+
+	BasicBlock * entry = BasicBlock::Create(ctx, "entry", wrapper);
+	BasicBlock * hit = BasicBlock::Create(ctx, "hit", wrapper);
+	BasicBlock * miss = BasicBlock::Create(ctx, "miss", wrapper);
+
+	Builder->SetInsertPoint(entry);
+
+	ArrayType * key_ty = ArrayType::get(dbl, std::max(1u, static_cast<unsigned>(_body->arg_size())));
+	Value * key = Builder->CreateAlloca(key_ty, nullptr, "key");
+	Value * cached = Builder->CreateAlloca(dbl, nullptr, "cached");
+
+	std::vector<Value *> args;
+	for(auto & arg : wrapper->args()) {
+		Builder->CreateStore(&arg, Builder->CreateConstInBoundsGEP2_32(key_ty, key, 0, arg.getArgNo()));
+		args.push_back(&arg);
+	}
+
+	Value * key_ptr = Builder->CreateConstInBoundsGEP2_32(key_ty, key, 0, 0);
+	Value * found = Builder->CreateCall(lookup_ty, lookup_fn, {cache, key_ptr, cached});
+	Builder->CreateCondBr(Builder->CreateICmpNE(found, Builder->getInt32(0)), hit, miss);
+
+	Builder->SetInsertPoint(hit);
+	Builder->CreateRet(Builder->CreateLoad(dbl, cached));
+
+	Builder->SetInsertPoint(miss);
+	Value * computed = Builder->CreateCall(_body, args);
+	Builder->CreateCall(store_ty, store_fn, {cache, key_ptr, computed});
+	Builder->CreateRet(computed);
+
+	VerifyGenerated(*wrapper);
+	return wrapper;
+}
+
+// a literal hoisting kernel is double(const double * literals), the
+// pointer is only ever read and never escapes
+static Function * DeclareKernel(const std::string & _name) {
+	Type * dbl = Type::getDoubleTy(*TheContext);
+	FunctionType * ft = FunctionType::get(dbl, {dbl->getPointerTo()}, false);
+
+	Function * f = Function::Create(ft, Function::ExternalLinkage, _name, TheModule.get());
+	f->getArg(0)->setName("__literals");
+	f->addParamAttr(0, Attribute::NoAlias);
+	f->addParamAttr(0, Attribute::NoCapture);
+	f->addParamAttr(0, Attribute::ReadOnly);
+
+	return f;
+}
+
+static FPMode FunctionFPMode(const PrototypeAST & _proto) {
+	if(_proto.hasAttribute(FunctionAttribute::Strict))
+		return FPMode::Strict;
+
+	if(_proto.hasAttribute(FunctionAttribute::FastMath))
+		return FPMode::Fast;
+
+	return DefaultFPMode;
+}
+
+Function* FunctionAST::codegen() const {
+	Function* theFunction = m_HoistLiterals ? DeclareKernel(getName())
+		: TheModule->getFunction(m_Proto->getName());
+
+	if(!theFunction)
+		theFunction = m_Proto->codegen();
+
+	if(!theFunction)
+		return nullptr;
+
+	// an inlining copy imported earlier gives way to the real thing
+	if(theFunction->hasAvailableExternallyLinkage())
+		theFunction->deleteBody();
+
+	if(!theFunction->empty()) {
+		LogErrorV("> Func cannot be redefined");
+		return nullptr;
+	}
+
+	BasicBlock* bb = BasicBlock::Create(*TheContext, "entry", theFunction);
+	Builder->SetInsertPoint(bb);
+
+	const FPMode fp_mode = FunctionFPMode(*m_Proto);
+	SetFPMode(fp_mode);
+
+	// lets the backend do what the flags on the instructions can't
+	// express, i.e. fusing across operations it combines itself
+	if(fp_mode == FPMode::Fast) {
+		theFunction->addFnAttr("unsafe-fp-math", "true");
+		theFunction->addFnAttr("no-nans-fp-math", "true");
+		theFunction->addFnAttr("no-infs-fp-math", "true");
+		theFunction->addFnAttr("no-signed-zeros-fp-math", "true");
+	}
+
+	NamedValues.clear();
+	for(auto & arg : theFunction->args())
+		NamedValues[std::string(arg.getName())] = &arg;
+
+	HoistedLiterals = m_HoistLiterals ? theFunction->getArg(0) : nullptr;
+	NextHoistedLiteral = 0;
+
+	Value* ret_val = m_Body->codegen();
+	HoistedLiterals = nullptr;
+
+	if(ret_val) {
+		Builder->CreateRet(ret_val);
+		VerifyGenerated(*theFunction);
+
+		const Hotness hotness = FunctionHotness(*m_Proto);
+		if(hotness == Hotness::Hot)
+			theFunction->setSectionPrefix("hot");
+		else if(hotness == Hotness::Cold)
+			theFunction->setSectionPrefix("unlikely");
+
+		// the wrapper bakes in the cache's address, useless in an object file
+		if(const BytecodeFunction * bc = TheBytecode->lookup(getName());
+				bc && bc->m_Memo && ObjectOutput.empty())
+			return EmitMemoWrapper(theFunction, bc->m_Memo);
+
+		return theFunction;
+	}
+
+	theFunction->eraseFromParent();
+	return nullptr;
+}
+
+#pragma endregion
+
+#pragma region BYTECODE_IMPL
+
+int NumberLiteralAST::emit(BytecodeCompiler & _bc) const {
+	int hoisted = _bc.nextHoistedLiteral();
+	return hoisted >= 0 ? hoisted : _bc.emitConstant(m_Value);
+}
+
+int VariableExpressionAST::emit(BytecodeCompiler & _bc) const {
+	return _bc.lookupVariable(m_Name);
+}
+
+int BinaryExpressionAST::emit(BytecodeCompiler & _bc) const {
+	const unsigned top = _bc.top();
+
+	if(isLogical()) {
+		// the result register only gets written at the very end, so
+		// it can share the LHS/RHS temporaries like everything else
+		const OpCode skip = m_Operator == Token::Token_and ? OpCode::JumpIfFalse : OpCode::JumpIfTrue;
+
+		int l = LHS->emit(_bc);
+		if(l < 0)
+			return -1;
+
+		size_t lhs_jump = _bc.emitJump(skip, l);
+
+		int r = RHS->emit(_bc);
+		if(r < 0)
+			return -1;
+
+		size_t rhs_jump = _bc.emitJump(skip, r);
+
+		_bc.reset(top);
+		int dst = _bc.allocate();
+		int fall = _bc.constantIndex(skip == OpCode::JumpIfFalse ? 1.0 : 0.0);
+		int jumped = _bc.constantIndex(skip == OpCode::JumpIfFalse ? 0.0 : 1.0);
+		if(dst < 0 || fall < 0 || jumped < 0)
+			return -1;
+
+		_bc.emit(OpCode::LoadK, dst, fall);
+		size_t end_jump = _bc.emitJump(OpCode::Jump);
+
+		_bc.patch(lhs_jump);
+		_bc.patch(rhs_jump);
+		_bc.emit(OpCode::LoadK, dst, jumped);
+		_bc.patch(end_jump);
+
+		return dst;
+	}
+
+	OpCode op;
+	bool swap {false};
+
+	switch(m_Operator) {
+		case '+':
+			op = OpCode::Add;
+			break;
+
+		case '-':
+			op = OpCode::Sub;
+			break;
+
+		case '*':
+			op = OpCode::Mul;
+			break;
+
+		case '<':
+			op = OpCode::CmpLT;
+			break;
+
+		case Token::Token_le:
+			op = OpCode::CmpLE;
+			break;
+
+		// a > b is b < a, which keeps NaN handling the same
+		case '>':
+			op = OpCode::CmpLT;
+			swap = true;
+			break;
+
+		case Token::Token_ge:
+			op = OpCode::CmpLE;
+			swap = true;
+			break;
+
+		case Token::Token_eq:
+			op = OpCode::CmpEQ;
+			break;
+
+		case Token::Token_ne:
+			op = OpCode::CmpNE;
+			break;
+
+		default:
+			return -1;
+	}
+
+	int l = LHS->emit(_bc);
+	int r = l < 0 ? -1 : RHS->emit(_bc);
+	if(r < 0)
+		return -1;
+
+	// both operands are consumed, so the result can take
+	// the first temporary either of them used
+	_bc.reset(top);
+	int dst = _bc.allocate();
+	if(dst < 0)
+		return -1;
+
+	if(swap)
+		std::swap(l, r);
+
+	_bc.emit(op, dst, l, r);
+	return dst;
+}
+
+int IfExpressionAST::emit(BytecodeCompiler & _bc) const {
+	const unsigned top = _bc.top();
+
+	int cond = m_Cond->emit(_bc);
+	if(cond < 0)
+		return -1;
+
+	size_t else_jump = _bc.emitJump(OpCode::JumpIfFalse, cond);
+
+	// both arms leave their value in dst, and evaluate their own
+	// temporaries above it
+	_bc.reset(top);
+	int dst = _bc.allocate();
+	if(dst < 0)
+		return -1;
+
+	int then = m_Then->emit(_bc);
+	if(then < 0)
+		return -1;
+
+	_bc.emit(OpCode::Move, dst, then);
+	_bc.reset(dst + 1);
+
+	size_t end_jump = _bc.emitJump(OpCode::Jump);
+	_bc.patch(else_jump);
+
+	int otherwise = m_Else->emit(_bc);
+	if(otherwise < 0)
+		return -1;
+
+	_bc.emit(OpCode::Move, dst, otherwise);
+	_bc.reset(dst + 1);
+	_bc.patch(end_jump);
+
+	return dst;
+}
+
+// builtins take their arguments in consecutive registers like a
+// call would, but never need a frame of their own
+static int EmitBuiltinCall(BytecodeCompiler & _bc, const int _builtin,
+		const std::vector<std::unique_ptr<ExpressionAST>> & _args) {
+
+	const unsigned base = _bc.top();
+	const size_t code_mark = _bc.mark();
+
+	double constant_args[3] {};
+	size_t num_constant {0};
+
+	for(size_t i {0}, e = _args.size(); i != e; ++i) {
+		int arg = _args[i]->emit(_bc);
+		if(arg < 0)
+			return -1;
+
+		if(num_constant == i && _bc.isConstant(arg, constant_args[i]))
+			++num_constant;
+
+		_bc.reset(base + i);
+		int slot = _bc.allocate();
+		if(slot < 0)
+			return -1;
+
+		if(arg != slot)
+			_bc.emit(OpCode::Move, slot, arg);
+	}
+
+	_bc.reset(base);
+
+	if(num_constant == _args.size()) {
+		_bc.rewind(code_mark);
+		return _bc.emitConstant(Builtins[_builtin].m_Eval(constant_args));
+	}
+
+	int dst = _bc.allocate();
+	if(dst < 0)
+		return -1;
+
+	_bc.emit(OpCode::CallBuiltin, dst, _builtin, static_cast<int>(_args.size()));
+	return dst;
+}
+
+int FuncCallAST::emit(BytecodeCompiler & _bc) const {
+	int callee = _bc.lookupFunction(m_Caller, m_Args.size());
+	if(callee < 0) {
+		if(int builtin = FindBuiltin(m_Caller, m_Args.size()); builtin >= 0)
+			return EmitBuiltinCall(_bc, builtin, m_Args);
+
+		return -1;
+	}
+
+	// arguments go into consecutive registers starting at base,
+	// which then becomes the callee's frame
+	const unsigned base = _bc.top();
+	const size_t code_mark = _bc.mark();
+
+	std::vector<double> constant_args;
+
 	for(size_t i {0}, e = m_Args.size(); i != e; ++i) {
-		args_v.push_back(m_Args[i]->codegen());
+		int arg = m_Args[i]->emit(_bc);
+		if(arg < 0)
+			return -1;
 
-		if(!args_v.back())
-			return nullptr;
+		double value {};
+		if(constant_args.size() == i && _bc.isConstant(arg, value))
+			constant_args.push_back(value);
+
+		_bc.reset(base + i);
+		int slot = _bc.allocate();
+		if(slot < 0)
+			return -1;
+
+		if(arg != slot)
+			_bc.emit(OpCode::Move, slot, arg);
+	}
+
+	_bc.reset(base);
+
+	// every argument folded to a constant, so try running the callee
+	// now and drop the argument code in favour of its result
+	double folded {};
+	if(constant_args.size() == m_Args.size() && Evaluate(_bc.module(),
+				_bc.module().at(callee), constant_args.data(), ConstEvalBudget, folded)) {
+		_bc.rewind(code_mark);
+		RecordUse(m_Caller, _bc.function().m_Name, true);
+		return _bc.emitConstant(folded);
 	}
 
-	return Builder->CreateCall(Calle, args_v, "calltmp");
+	int dst = _bc.allocate();
+	if(dst < 0)
+		return -1;
+
+	RecordUse(m_Caller, _bc.function().m_Name, false);
+	_bc.emit(OpCode::Call, dst, callee, static_cast<int>(m_Args.size()));
+	return dst;
 }
 
-Function* PrototypeAST::codegen() {
-	std::vector<Type *> Doubles(m_Args.size(), Type::getDoubleTy(*TheContext));
+bool FunctionAST::lower(const BytecodeModule & _module, BytecodeFunction & _fn) const {
+	BytecodeCompiler bc {_module, _fn, m_Proto->getArgs(), m_HoistLiterals ? m_NumLiterals : 0};
+	return bc.finish(m_Body->emit(bc));
+}
 
-	FunctionType* ft = FunctionType::get(
-		Type::getDoubleTy(*TheContext), Doubles, false
-	);
+#pragma endregion
 
-	FunctionType* f = Function::Create(
-		ft, Function::ExternalLinkage, Name, TheModule.get()
-	);
+#pragma region FINGERPRINT_IMPL
 
-	size_t idx {0};
+void NumberLiteralAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::Number);
+	_fp.number(m_Value);
+}
 
-	for(auto & Arg : F->arg)
-		Arg.setName(m_Args[idx++]);
+void StringLiteralAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::String);
+	_fp.name(m_Literal);
+}
 
-	return f;
+void VariableExpressionAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.variable(m_Name);
 }
 
-Function* FunctionAST::codegen() {
-	Function* theFunction = TheModule->getFunction(proto->getName());
+void BinaryExpressionAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::Binary);
+	_fp.integer(static_cast<uint32_t>(m_Operator));
 
-	if(!theFunction)
-		theFunction = proto->codegen();
+	LHS->fingerprint(_fp);
+	RHS->fingerprint(_fp);
+}
 
-	if(!theFunction)
-		return nullptr;
+void IfExpressionAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::If);
 
-	if(!theFunction->empty())
-		return dynamic_cast<Function* > (LogErrorV("> Func cannot be redefined"));
+	m_Cond->fingerprint(_fp);
+	m_Then->fingerprint(_fp);
+	m_Else->fingerprint(_fp);
+}
 
-	BasicBlock* bb = BasicBlock::Create(*TheContext, "entry", theFunction);
-	Builder->SetInsertPoint(bb);
+void FPModeExpressionAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::FPMode);
+	_fp.integer(static_cast<uint32_t>(m_Mode));
 
-	NamedValues.clear();
-	for(auto & arg : theFunction->m_Args)
-		NamedValues[std::string(arg.getName())] = &arg;
+	m_Body->fingerprint(_fp);
+}
 
-	if(Value* ret_val = Body->codegen()) {
-		Builder->CreateRet(ret_val);
-		verifyFunction(*theFunction);
+void BranchHintExpressionAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::BranchHint);
+	_fp.integer(static_cast<uint32_t>(m_Hint));
+
+	m_Body->fingerprint(_fp);
+}
+
+void FuncCallAST::fingerprint(AstFingerprint & _fp) const {
+	_fp.tag(NodeTag::Call);
+	_fp.name(m_Caller);
+	_fp.integer(static_cast<uint32_t>(m_Args.size()));
+
+	for(const auto & arg : m_Args)
+		arg->fingerprint(_fp);
+}
+
+void FunctionAST::fingerprint(AstFingerprint & _fp) const {
+	const auto & args = m_Proto->getArgs();
+
+	_fp.tag(NodeTag::Function);
+	_fp.integer(static_cast<uint32_t>(args.size()));
+
+	// same body, different rounding, so a different kernel
+	_fp.integer(static_cast<uint32_t>(FunctionFPMode(*m_Proto)));
+
+	for(const auto & arg : args)
+		_fp.bind(arg);
+
+	m_Body->fingerprint(_fp);
+}
+
+#pragma endregion
+
+#pragma region DRIVER
+
+// lexes _source with 1, 2, 4 ... threads up to the core count and
+// reports throughput, the numbers --bench-lex prints
+static void BenchmarkLexer(const std::string & _source) {
+	using Clock = std::chrono::steady_clock;
+
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	const double megabytes = _source.size() / (1024.0 * 1024.0);
+	double baseline {0.0};
+
+	fprintf(stderr, "> Lexing %.1f MB\n", megabytes);
+
+	for(unsigned threads {1}; ; threads = std::min(threads * 2, cores)) {
+		// best of three, the first run also pays for faulting the pages in
+		double best {0.0};
+		size_t count {0};
+
+		for(int run {0}; run < 3; ++run) {
+			const auto start = Clock::now();
+			count = LexParallel(_source, threads).size();
+			const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			if(run == 0 || seconds < best)
+				best = seconds;
+		}
+
+		if(threads == 1)
+			baseline = best;
 
-		return theFunction();
+		fprintf(stderr, ">   %2u threads: %8.1f ms  %8.1f MB/s  %5.2fx  (%zu tokens)\n",
+				threads, best * 1000.0, megabytes / best, baseline / best, count);
+
+		if(threads == cores)
+			break;
 	}
+}
 
-	theFunction->eraseFromParent();
-	return nullptr;
+// peak resident set size in bytes, from VmHWM
+static size_t PeakRSS() {
+	FILE * status = fopen("/proc/self/status", "r");
+	if(!status)
+		return 0;
+
+	char line[256];
+	size_t peak {0};
+
+	while(fgets(line, sizeof(line), status)) {
+		if(sscanf(line, "VmHWM: %zu kB", &peak) == 1) {
+			peak *= 1024;
+			break;
+		}
+	}
+
+	fclose(status);
+	return peak;
+}
+
+// feeds _count generated definitions through streaming mode, each one
+// calling the one before it so retired prototypes get declared too,
+// RSS is reported every 100k functions by FlushStream
+static void BenchmarkStream(const size_t _count) {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t ChunkSize = 4096;
+	const auto start = Clock::now();
+
+	for(size_t first {0}; first < _count; first += ChunkSize) {
+		std::string source;
+
+		for(size_t i {first}; i < std::min(_count, first + ChunkSize); ++i) {
+			source += "func s" + std::to_string(i) + "(x) ";
+			source += i ? "s" + std::to_string(i - 1) + "(x) + " + std::to_string(i) : "x";
+			source += "\n";
+		}
+
+		const std::vector<LexedToken> tokens = LexBuffer(source.data(), source.data() + source.size());
+		VectorTokenSource chunk {tokens};
+
+		ParseItems(chunk, [](ParsedItem && _item) { DefineFunction(std::move(_item.m_Ast)); });
+	}
+
+	FlushStream();
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	fprintf(stderr, "> Streamed %zu functions in %.1f s, rss %.1f MB, peak %.1f MB\n", _count,
+			seconds, CurrentRSS() / (1024.0 * 1024.0), PeakRSS() / (1024.0 * 1024.0));
+}
+
+// compiles _count distinct top level expressions natively, a module
+// each like a stream of cache misses, and keeps them in the expression
+// cache so evicted ones free their code. Reports throughput, RSS and
+// what the code memory pool is holding on to
+static void BenchmarkJit(const size_t _count) {
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t ChunkSize = 4096;
+	const auto start = Clock::now();
+	size_t compiled {0};
+
+	auto report = [&](const char * _what) {
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		fprintf(stderr, "> %s %zu expressions in %.1f s (%.0f/s), rss %.1f MB, peak %.1f MB\n", _what,
+				compiled, seconds, compiled / seconds, CurrentRSS() / (1024.0 * 1024.0),
+				PeakRSS() / (1024.0 * 1024.0));
+
+		if(const CodeMemoryPool * pool = GetJIT().codeMemory()) {
+			const CodeMemoryPool::Stats stats = pool->stats();
+
+			auto live = [&](const CodeMemoryPool::Kind _kind) {
+				return stats.m_LiveByKind[static_cast<size_t>(_kind)] / 1024.0;
+			};
+
+			fprintf(stderr, ">   code memory: %zu slabs, %.1f MB mapped, %.1f KB live, %llu blocks, "
+					"%llu mprotects%s\n", stats.m_Slabs, stats.m_Mapped / (1024.0 * 1024.0),
+					stats.m_Live / 1024.0, static_cast<unsigned long long>(stats.m_Blocks),
+					static_cast<unsigned long long>(stats.m_Protects),
+					stats.m_DualMapped ? ", dual mapped" : "");
+			fprintf(stderr, ">   live code: %.1f KB hot, %.1f KB normal, %.1f KB cold\n",
+					live(CodeMemoryPool::Kind::HotCode), live(CodeMemoryPool::Kind::Code),
+					live(CodeMemoryPool::Kind::ColdCode));
+		}
+	};
+
+	for(size_t first {0}; first < _count; first += ChunkSize) {
+		std::string source;
+
+		for(size_t i {first}; i < std::min(_count, first + ChunkSize); ++i)
+			source += std::to_string(i) + " * 3 + 1;\n";
+
+		const std::vector<LexedToken> tokens = LexBuffer(source.data(), source.data() + source.size());
+		VectorTokenSource chunk {tokens};
+
+		ParseItems(chunk, [&](ParsedItem && _item) {
+			if(!_item.m_TopLevel)
+				return;
+
+			AstFingerprint fp {false};
+			_item.m_Ast->fingerprint(fp);
+
+			auto entry = std::make_shared<CachedExpression>();
+			entry->m_Ast = std::move(_item.m_Ast);
+
+			if(!CompileExpression(*entry))
+				return;
+
+			if(++compiled % 100'000 == 0)
+				report("JIT'd");
+
+			if(fp.valid())
+				ExpressionCache.insert(fp.bytes(), std::move(entry));
+		});
+	}
+
+	report("JIT'd");
+}
+
+// runs this binary _count times per script, each timed from spawn to
+// exit so the dynamic loader and static constructors (LLVM's included)
+// count along with main. Against a shared libLLVM that's most of the
+// time, linking only the components used statically, i.e. with
+// `llvm-config --link-static --libs orcjit native passes ipo bitreader
+// bitwriter`, leaves far less for the loader to do
+static void BenchmarkStartup(const size_t _count) {
+	using Clock = std::chrono::steady_clock;
+
+	struct Script {
+		const char * m_Label;
+		const char * m_Source;
+		const char * m_Flag;
+	};
+
+	// up to the first prompt, then a result the interpreter gets to
+	// without LLVM and one that has to go through the JIT
+	const Script scripts[] {
+		{"ready", "", "--exit-at-ready"},
+		{"interpreted result", "func twice(x) x * 2;\ntwice(21);\n", nullptr},
+		{"native result", "func @hot twice(x) x * 2;\ntwice(21);\n", nullptr},
+	};
+
+	char self[] {"/proc/self/exe"};
+
+	for(const Script & script : scripts) {
+		std::vector<double> times;
+
+		for(size_t i {0}; i < _count; ++i) {
+			int input[2];
+			if(pipe(input) < 0) {
+				fprintf(stderr, "> Error: couldn't make a pipe: %s\n", strerror(errno));
+				return;
+			}
+
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_adddup2(&actions, input[0], STDIN_FILENO);
+			posix_spawn_file_actions_addclose(&actions, input[1]);
+			posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+			posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+			char * args[] {self, const_cast<char *>(script.m_Flag), nullptr};
+
+			const auto start = Clock::now();
+
+			pid_t pid;
+			const int error = posix_spawn(&pid, self, &actions, nullptr, args, environ);
+			posix_spawn_file_actions_destroy(&actions);
+			close(input[0]);
+
+			if(error) {
+				close(input[1]);
+				fprintf(stderr, "> Error: couldn't start %s: %s\n", self, strerror(error));
+				return;
+			}
+
+			// a few bytes, the pipe takes them without the child reading
+			if(const size_t size = strlen(script.m_Source))
+				if(write(input[1], script.m_Source, size) < 0)
+					fprintf(stderr, "> Warning: couldn't send the script: %s\n", strerror(errno));
+			close(input[1]);
+
+			int status {0};
+			waitpid(pid, &status, 0);
+
+			if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+				fprintf(stderr, "> Error: the %s run failed\n", script.m_Label);
+				return;
+			}
+
+			times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		if(times.empty())
+			return;
+
+		std::sort(times.begin(), times.end());
+		fprintf(stderr, "> %-20s min %.2f ms, median %.2f ms over %zu runs\n", script.m_Label,
+				times.front(), times[times.size() / 2], times.size());
+	}
+}
+
+// Allocation check for the parser, --check-alloc. Every allocation made
+// while CountAllocations is set on a thread is counted, the rest of the
+// program just pays for the one test of a thread_local
+static thread_local bool CountAllocations {false};
+static thread_local size_t AllocationCount {0};
+
+void * operator new(size_t _size) {
+	if(CountAllocations)
+		++AllocationCount;
+
+	if(void * ptr = malloc(_size ? _size : 1))
+		return ptr;
+
+	// built without exceptions, there's no bad_alloc to throw
+	fprintf(stderr, "> Error: out of memory\n");
+	abort();
+}
+
+[[gnu::noinline]] void operator delete(void * _ptr) noexcept {
+	free(_ptr);
+}
+
+[[gnu::noinline]] void operator delete(void * _ptr, size_t) noexcept {
+	free(_ptr);
+}
+
+// hands tokens over the way the pipeline's parser gets them, moved
+// out of a batch the lexer filled ahead of time
+class MovingTokenSource : public TokenSource {
+	std::vector<LexedToken> & m_Tokens;
+	size_t m_Pos {0};
+
+	public:
+		explicit MovingTokenSource(std::vector<LexedToken> & _tokens) : m_Tokens {_tokens} {}
+
+		virtual int next() override {
+			if(m_Pos == m_Tokens.size() || m_Tokens[m_Pos].m_Kind == Token::Token_EOF)
+				return Token::Token_EOF;
+
+			return RestoreToken(std::move(m_Tokens[m_Pos++]));
+		}
+};
+
+// parses each definition with allocations counted and compares them to
+// what its nodes need: one allocation per node and one per non-empty
+// argument list. Names are longer than any small string buffer, so a
+// name copied anywhere on the way into the tree shows up as an extra
+static bool CheckParseAllocations() {
+	static const struct {
+		const char * m_Source;
+		size_t m_Expected;
+	} Cases[] {
+		// prototype, function, number
+		{"func constantFortyTwo() 42", 3},
+
+		// prototype, function, variable, argument list
+		{"func identityOfArgument(theOnlyArgumentGiven) theOnlyArgumentGiven", 4},
+
+		// prototype, function, 3 variables, 2 numbers, 4 binaries, argument list
+		{"func weightedSumOfThree(firstWeightedArgument secondWeightedArgument thirdWeightedArgument) "
+			"firstWeightedArgument * 2 + secondWeightedArgument * 3 + thirdWeightedArgument", 12},
+
+		// prototype, function, call, binary, variable, number, 2 argument lists
+		{"func callsAnotherFunction(someArgumentNameHere) "
+			"identityOfArgument(someArgumentNameHere + 1)", 8},
+
+		// prototype, function, if, binary, 4 variables, argument list
+		{"func chooseTheBiggerOne(leftHandSideValue rightHandSideValue) "
+			"if leftHandSideValue < rightHandSideValue then rightHandSideValue else leftHandSideValue", 9},
+	};
+
+	bool ok {true};
+
+	for(const auto & test : Cases) {
+		const std::string source = test.m_Source;
+		std::vector<LexedToken> tokens = LexBuffer(source.data(), source.data() + source.size());
+
+		MovingTokenSource moving {tokens};
+		ActiveTokenSource = &moving;
+		GetNextToken();
+
+		AllocationCount = 0;
+		CountAllocations = true;
+		std::unique_ptr<FunctionAST> fn = ParseDefinition();
+		CountAllocations = false;
+
+		ActiveTokenSource = nullptr;
+
+		const bool passed = fn && AllocationCount == test.m_Expected;
+		fprintf(stderr, "> %s %-28s %zu allocations, expected %zu\n", passed ? "ok  " : "FAIL",
+				fn ? fn->getName().c_str() : "(parse error)", AllocationCount, test.m_Expected);
+
+		ok &= passed;
+	}
+
+	return ok;
+}
+
+int main(int argc, char ** argv) {
+	bool pipeline {false};
+	bool bench_lex {false};
+	bool check_alloc {false};
+	unsigned lex_threads {0};
+	unsigned parse_threads {0};
+	size_t bench_stream {0};
+	size_t bench_jit {0};
+	size_t bench_startup {0};
+	bool exit_at_ready {false};
+	const char * profile_out {nullptr};
+	const char * server_path {nullptr};
+	const char * connect_path {nullptr};
+	bool stop_server {false};
+
+	for(int i {1}; i < argc; ++i) {
+		if(!strcmp(argv[i], "--hoist-literals")) {
+			HoistLiterals = true;
+		} else if(!strcmp(argv[i], "--pipeline")) {
+			pipeline = true;
+		} else if(!strcmp(argv[i], "--lex-threads") && i + 1 < argc) {
+			lex_threads = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--parse-threads") && i + 1 < argc) {
+			parse_threads = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--fast-compile") || !strcmp(argv[i], "-O0")) {
+			FastCompile = true;
+		} else if(!strcmp(argv[i], "--fp-contract")) {
+			DefaultFPMode = FPMode::Contract;
+		} else if(!strcmp(argv[i], "--fast-math")) {
+			DefaultFPMode = FPMode::Fast;
+		} else if(!strcmp(argv[i], "--load") && i + 1 < argc) {
+			std::string error;
+			if(!LoadExternLibrary(argv[++i], error)) {
+				fprintf(stderr, "> Error: couldn't load %s: %s\n", argv[i], error.c_str());
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--vector-math")) {
+			VectorizeMath = true;
+		} else if(!strcmp(argv[i], "--hot-reload")) {
+			HotReload = true;
+		} else if(!strcmp(argv[i], "--streaming")) {
+			Streaming = true;
+		} else if(!strcmp(argv[i], "--bench-stream") && i + 1 < argc) {
+			Streaming = true;
+			bench_stream = strtoull(argv[++i], nullptr, 10);
+		} else if(!strcmp(argv[i], "--bench-jit") && i + 1 < argc) {
+			bench_jit = strtoull(argv[++i], nullptr, 10);
+		} else if(!strcmp(argv[i], "--profile") && i + 1 < argc) {
+			if(!LoadProfile(argv[++i])) {
+				fprintf(stderr, "> Error: couldn't read profile %s\n", argv[i]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "--write-profile") && i + 1 < argc) {
+			profile_out = argv[++i];
+		} else if(!strcmp(argv[i], "--split-cold")) {
+			SplitColdCode = true;
+		} else if(!strcmp(argv[i], "--section-memory")) {
+			PooledCodeMemory = false;
+		} else if(!strcmp(argv[i], "--huge-pages")) {
+			HugePages = true;
+		} else if(!strcmp(argv[i], "--eager-jit")) {
+			EagerJIT = true;
+		} else if(!strcmp(argv[i], "-j") && i + 1 < argc) {
+			CompileJobs = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--time-jobs")) {
+			ReportJobs = true;
+		} else if(!strcmp(argv[i], "--emit-obj") && i + 1 < argc) {
+			ObjectOutput = argv[++i];
+		} else if(!strcmp(argv[i], "--server") && i + 1 < argc) {
+			server_path = argv[++i];
+		} else if(!strcmp(argv[i], "--connect") && i + 1 < argc) {
+			connect_path = argv[++i];
+		} else if(!strcmp(argv[i], "--stop")) {
+			stop_server = true;
+		} else if(!strcmp(argv[i], "--bench-startup") && i + 1 < argc) {
+			bench_startup = strtoull(argv[++i], nullptr, 10);
+		} else if(!strcmp(argv[i], "--exit-at-ready")) {
+			exit_at_ready = true;
+		} else if(!strcmp(argv[i], "--bench-lex")) {
+			bench_lex = true;
+		} else if(!strcmp(argv[i], "--check-alloc")) {
+			check_alloc = true;
+		} else {
+			fprintf(stderr, "> Error: unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// the client only forwards stdin, it never needs LLVM at all
+	if(connect_path) {
+		if(stop_server)
+			return RunClient(connect_path, ServerRequest::Kind::Stop, {});
+
+		if(ObjectOutput.empty())
+			return RunClient(connect_path, ServerRequest::Kind::Run, {});
+
+		// the server writes relative to its own working directory
+		std::string prefix = ObjectOutput;
+		if(prefix.front() != '/') {
+			if(char * cwd = getcwd(nullptr, 0)) {
+				prefix = std::string {cwd} + "/" + prefix;
+				free(cwd);
+			}
+		}
+
+		return RunClient(connect_path, ServerRequest::Kind::EmitObject, prefix);
+	}
+
+	if(bench_startup) {
+		BenchmarkStartup(bench_startup);
+		return 0;
+	}
+
+	if(server_path) {
+		if(!ObjectOutput.empty()) {
+			fprintf(stderr, "> Error: --emit-obj is per request with --server, pass it to --connect\n");
+			return 1;
+		}
+
+		// clients are expected to resubmit definitions as they change
+		HotReload = true;
+	}
+
+	// 1 is the lowest precedence
+	BinOpPrecedence[Token::Token_or] = 4;
+	BinOpPrecedence[Token::Token_and] = 6;
+	BinOpPrecedence[Token::Token_eq] = 8;
+	BinOpPrecedence[Token::Token_ne] = 8;
+	BinOpPrecedence['<'] = 10;
+	BinOpPrecedence[Token::Token_le] = 10;
+	BinOpPrecedence['>'] = 10;
+	BinOpPrecedence[Token::Token_ge] = 10;
+	BinOpPrecedence['+'] = 20;
+	BinOpPrecedence['-'] = 20;
+	BinOpPrecedence['*'] = 40;
+
+	if(check_alloc)
+		return CheckParseAllocations() ? 0 : 1;
+
+	// reads the whole of stdin and lexes it up front rather than a
+	// token at a time, only worth it for big generated files
+	std::vector<LexedToken> prelexed;
+
+	if(bench_lex || lex_threads || parse_threads || !ObjectOutput.empty()) {
+		const std::string source = ReadSource(stdin);
+
+		if(bench_lex) {
+			BenchmarkLexer(source);
+			return 0;
+		}
+
+		prelexed = LexParallel(source, std::max(1u, lex_threads));
+	}
+
+	TheBytecode = std::make_unique<BytecodeModule>();
+
+	// the pipeline leaves the lexer and parser a core each
+	if(pipeline) {
+		const unsigned cores = std::thread::hardware_concurrency();
+		JITCompileThreads = cores > 3 ? cores - 2 : 1;
+	}
+
+	TierUpHook = PromoteToNative;
+
+	// object files are written once, there's nothing to swap
+	if(!ObjectOutput.empty())
+		HotReload = false;
+
+	VectorTokenSource tokens {prelexed};
+
+	if(bench_stream) {
+		BenchmarkStream(bench_stream);
+		return 0;
+	}
+
+	if(bench_jit) {
+		BenchmarkJit(bench_jit);
+		return 0;
+	}
+
+	if(!ObjectOutput.empty()) {
+		ParseItems(tokens, [](ParsedItem && _item) {
+			if(_item.m_Extern)
+				DeclareExtern(std::move(_item.m_Extern));
+			else if(_item.m_TopLevel)
+				fprintf(stderr, "> Warning: top level expressions are ignored with --emit-obj\n");
+			else
+				DefineFunction(std::move(_item.m_Ast));
+		});
+
+		return EmitObjectFiles(ObjectOutput) ? 0 : 1;
+	}
+
+	// what --bench-startup times up to, the point input starts being read
+	if(exit_at_ready)
+		return 0;
+
+	if(server_path) {
+		// warm from the first request on
+		GetJIT();
+
+		if(!RunServer(server_path, ServeRequest))
+			return 1;
+	} else if(parse_threads) {
+		RunParallelParse(prelexed, parse_threads);
+	} else if(pipeline) {
+		RunPipeline(lex_threads ? &prelexed : nullptr);
+	} else {
+		if(lex_threads)
+			ActiveTokenSource = &tokens;
+
+		fprintf(stderr, "> Ready! ");
+		GetNextToken();
+
+		repl();
+	}
+
+	FlushStream();
+	PrintMemoStats(stderr);
+
+	if(profile_out && !WriteProfile(profile_out))
+		fprintf(stderr, "> Error: couldn't write profile %s\n", profile_out);
+
+	return 0;
 }
 
 #pragma endregion
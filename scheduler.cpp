@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "scheduler.hpp"
+#include "spsc.hpp"
+
+// asking for the core count reads /sys, so it's put off until the
+// first batch of jobs rather than done before main on every start
+unsigned CompileJobs {0};
+
+unsigned JobCount() {
+	if(!CompileJobs)
+		CompileJobs = std::max(1u, std::thread::hardware_concurrency());
+
+	return CompileJobs;
+}
+
+#pragma region WORKER_POOL
+
+// The threads every scheduler runs its jobs on. They're started the
+// first time a batch needs them and then stay parked for the rest of
+// the process, so whatever a job keeps in thread_locals (a
+// TargetMachine, a codegen context) is set up once per thread rather
+// than once per batch
+class WorkerPool {
+	std::mutex m_Lock;
+	std::condition_variable m_Wake;
+	std::condition_variable m_Done;
+	std::vector<std::thread> m_Threads;
+
+	const std::function<void (unsigned)> * m_Work {nullptr};
+	unsigned m_Workers {0};
+	unsigned m_Running {0};
+	uint64_t m_Batch {0};
+
+	// one batch at a time, the pool's threads are all shared
+	std::mutex m_RunLock;
+
+	void loop(const unsigned _id) {
+		uint64_t seen {0};
+		std::unique_lock<std::mutex> lock {m_Lock};
+
+		while(true) {
+			m_Wake.wait(lock, [&] { return m_Batch != seen; });
+			seen = m_Batch;
+
+			if(_id >= m_Workers)
+				continue;
+
+			const std::function<void (unsigned)> & work = *m_Work;
+			lock.unlock();
+			work(_id);
+			lock.lock();
+
+			if(--m_Running == 0)
+				m_Done.notify_one();
+		}
+	}
+
+	public:
+		// _work(0) runs on the calling thread and _work(1) to
+		// _work(_workers - 1) on pool threads, returns how many of them
+		// took part. A batch started while another one has the pool
+		// (from one of its own jobs, say) runs on the caller alone
+		unsigned run(const unsigned _workers, const std::function<void (unsigned)> & _work) {
+			std::unique_lock<std::mutex> batch {m_RunLock, std::try_to_lock};
+			const unsigned workers = batch.owns_lock() ? _workers : 1;
+
+			if(workers > 1) {
+				std::lock_guard<std::mutex> lock {m_Lock};
+
+				while(m_Threads.size() + 1 < workers) {
+					const unsigned id = static_cast<unsigned>(m_Threads.size()) + 1;
+					m_Threads.emplace_back([this, id] { loop(id); });
+				}
+
+				m_Work = &_work;
+				m_Workers = workers;
+				m_Running = workers - 1;
+				++m_Batch;
+			}
+
+			m_Wake.notify_all();
+			_work(0);
+
+			if(workers > 1) {
+				std::unique_lock<std::mutex> lock {m_Lock};
+				m_Done.wait(lock, [&] { return m_Running == 0; });
+				m_Work = nullptr;
+			}
+
+			return workers;
+		}
+};
+
+// never destroyed, the threads are parked for good and whatever their
+// thread_locals point into may already be gone by the time statics are
+static WorkerPool & Pool() {
+	static WorkerPool * pool = new WorkerPool;
+	return *pool;
+}
+
+#pragma endregion
+
+#pragma region JOB_SCHEDULER
+
+// a deque behind a lock is plenty here, jobs are whole functions or
+// partitions so they're pushed and popped a handful of times per
+// millisecond at most
+struct alignas(64) JobScheduler::Worker {
+	std::mutex m_Lock;
+	std::deque<Job *> m_Queue;
+
+	void push(Job * _job) {
+		std::lock_guard<std::mutex> lock {m_Lock};
+		m_Queue.push_back(_job);
+	}
+
+	Job * pop() {
+		std::lock_guard<std::mutex> lock {m_Lock};
+		if(m_Queue.empty())
+			return nullptr;
+
+		Job * job = m_Queue.back();
+		m_Queue.pop_back();
+		return job;
+	}
+
+	Job * steal() {
+		std::lock_guard<std::mutex> lock {m_Lock};
+		if(m_Queue.empty())
+			return nullptr;
+
+		Job * job = m_Queue.front();
+		m_Queue.pop_front();
+		return job;
+	}
+};
+
+JobScheduler::JobScheduler(const unsigned _workers) : m_NumWorkers {std::max(1u, _workers)} {}
+
+JobScheduler::JobHandle JobScheduler::add(std::string _label, std::function<void ()> _work) {
+	auto job = std::make_unique<Job>();
+	job->m_Label = std::move(_label);
+	job->m_Work = std::move(_work);
+
+	m_Jobs.push_back(std::move(job));
+	return m_Jobs.back().get();
+}
+
+void JobScheduler::depends(JobHandle _job, JobHandle _on) {
+	_on->m_Dependents.push_back(_job);
+	_job->m_Pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobScheduler::run() {
+	using Clock = std::chrono::steady_clock;
+
+	const unsigned workers = std::min<size_t>(m_NumWorkers, std::max<size_t>(1, m_Jobs.size()));
+	std::unique_ptr<Worker[]> queues = std::make_unique<Worker[]>(workers);
+	std::atomic<size_t> remaining {m_Jobs.size()};
+
+	// anything without dependencies is ready, spread it round robin
+	unsigned next {0};
+	for(const auto & job : m_Jobs) {
+		if(job->m_Pending.load(std::memory_order_relaxed) == 0)
+			queues[next++ % workers].push(job.get());
+	}
+
+	auto work = [&](const unsigned _id) {
+		unsigned spins {0};
+
+		while(remaining.load(std::memory_order_acquire) != 0) {
+			Job * job = queues[_id].pop();
+
+			for(unsigned i {1}; !job && i < workers; ++i)
+				job = queues[(_id + i) % workers].steal();
+
+			if(!job) {
+				RingBackoff(spins);
+				continue;
+			}
+
+			spins = 0;
+
+			const auto start = Clock::now();
+			job->m_Work();
+			job->m_Seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			job->m_Worker = _id;
+
+			for(Job * dependent : job->m_Dependents) {
+				if(dependent->m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					queues[_id].push(dependent);
+			}
+
+			remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	};
+
+	const auto start = Clock::now();
+
+	m_RanWorkers = Pool().run(workers, work);
+
+	m_WallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void JobScheduler::report(FILE * _out) const {
+	std::vector<const Job *> jobs;
+	double busy {0.0};
+
+	for(const auto & job : m_Jobs) {
+		jobs.push_back(job.get());
+		busy += job->m_Seconds;
+	}
+
+	std::sort(jobs.begin(), jobs.end(), [](const Job * _a, const Job * _b) {
+		return _a->m_Seconds > _b->m_Seconds;
+	});
+
+	fprintf(_out, "> %zu jobs on %u workers: %.2f ms wall, %.2f ms busy (%.2fx)\n",
+			jobs.size(), m_RanWorkers, m_WallSeconds * 1000.0, busy * 1000.0,
+			m_WallSeconds > 0.0 ? busy / m_WallSeconds : 0.0);
+
+	for(const Job * job : jobs) {
+		fprintf(_out, ">   %9.3f ms  [%2u]  %s\n", job->m_Seconds * 1000.0,
+				job->m_Worker, job->m_Label.c_str());
+	}
+}
+
+#pragma endregion
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// how many threads compile jobs run on, set by -j. Left at 0 it's one
+// per core, read it through JobCount()
+extern unsigned CompileJobs;
+
+unsigned JobCount();
+
+// Work stealing scheduler for compile jobs. Every worker owns a deque
+// it pushes to and pops from at the back, idle workers steal from the
+// front of someone else's. Jobs carry a counter of unfinished jobs
+// they depend on and are queued by whichever worker finishes the last
+// of them, so a chain of jobs tends to stay on one thread
+class JobScheduler {
+	struct Job {
+		std::string m_Label {};
+		std::function<void ()> m_Work;
+
+		std::atomic<unsigned> m_Pending {0};
+		std::vector<Job *> m_Dependents;
+
+		double m_Seconds {0.0};
+		unsigned m_Worker {0};
+	};
+
+	struct Worker;
+
+	std::vector<std::unique_ptr<Job>> m_Jobs;
+	unsigned m_NumWorkers {1};
+
+	// what the last run() actually got, fewer with fewer jobs than
+	// workers or with the worker pool busy
+	unsigned m_RanWorkers {0};
+	double m_WallSeconds {0.0};
+
+	public:
+		using JobHandle = Job *;
+
+		explicit JobScheduler(const unsigned _workers);
+
+		JobHandle add(std::string _label, std::function<void ()> _work);
+
+		// _job won't start before _on has finished, only valid before run()
+		void depends(JobHandle _job, JobHandle _on);
+
+		// runs every job added so far, the calling thread works too
+		void run();
+
+		// per job timings of the last run(), slowest first
+		void report(FILE * _out) const;
+};
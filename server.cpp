@@ -0,0 +1,293 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+#pragma region SOCKET
+
+// how long a client gets to send its request, and to take the reply
+// off our hands, before the server moves on to the next one
+static constexpr int ClientTimeoutSeconds = 30;
+
+static const char * const KindNames[] = {"run", "emit-obj", "stop"};
+
+static bool SocketAddress(const std::string & _path, sockaddr_un & _addr) {
+	if(_path.size() >= sizeof(_addr.sun_path)) {
+		fprintf(stderr, "> Error: socket path %s is too long\n", _path.c_str());
+		return false;
+	}
+
+	memset(&_addr, 0, sizeof(_addr));
+	_addr.sun_family = AF_UNIX;
+	memcpy(_addr.sun_path, _path.c_str(), _path.size() + 1);
+
+	return true;
+}
+
+// -1 with errno set if nobody's listening on _path
+static int Connect(const sockaddr_un & _addr) {
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -1;
+
+	if(connect(fd, reinterpret_cast<const sockaddr *>(&_addr), sizeof(_addr)) < 0) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		return -1;
+	}
+
+	return fd;
+}
+
+static bool WriteAll(const int _fd, const char * _data, size_t _size) {
+	while(_size) {
+		const ssize_t n = write(_fd, _data, _size);
+		if(n < 0 && errno == EINTR)
+			continue;
+
+		if(n <= 0)
+			return false;
+
+		_data += n;
+		_size -= static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+// everything up to the other side's end of stream
+static bool ReadAll(const int _fd, std::string & _out) {
+	char buffer[1 << 16];
+
+	while(true) {
+		const ssize_t n = read(_fd, buffer, sizeof(buffer));
+		if(n < 0 && errno == EINTR)
+			continue;
+
+		if(n < 0)
+			return false;
+
+		if(n == 0)
+			return true;
+
+		_out.append(buffer, static_cast<size_t>(n));
+	}
+}
+
+static bool ParseRequest(std::string _data, ServerRequest & _request) {
+	const size_t eol = _data.find('\n');
+	if(eol == std::string::npos)
+		return false;
+
+	const std::string header = _data.substr(0, eol);
+	const size_t space = header.find(' ');
+	const std::string kind = header.substr(0, space);
+
+	bool known {false};
+	for(size_t i {0}; i < std::size(KindNames); ++i) {
+		if(kind == KindNames[i]) {
+			_request.m_Kind = static_cast<ServerRequest::Kind>(i);
+			known = true;
+		}
+	}
+
+	if(!known)
+		return false;
+
+	_request.m_Argument = space == std::string::npos ? std::string {} : header.substr(space + 1);
+	_request.m_Source = _data.erase(0, eol + 1);
+
+	return true;
+}
+
+#pragma endregion
+
+#pragma region SERVER
+
+// runs _handler with stdout and stderr pointed at the client, so
+// everything the compiler prints already knows where to go
+static int HandleWithOutputTo(const int _client, const ServerHandler & _handler,
+		const ServerRequest & _request) {
+	fflush(stdout);
+	fflush(stderr);
+
+	const int saved_out = dup(STDOUT_FILENO);
+	const int saved_err = dup(STDERR_FILENO);
+
+	dup2(_client, STDOUT_FILENO);
+	dup2(_client, STDERR_FILENO);
+
+	const int status = _handler(_request);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	dup2(saved_out, STDOUT_FILENO);
+	dup2(saved_err, STDERR_FILENO);
+	close(saved_out);
+	close(saved_err);
+
+	return status;
+}
+
+bool RunServer(const std::string & _path, const ServerHandler & _handler) {
+	sockaddr_un addr;
+	if(!SocketAddress(_path, addr))
+		return false;
+
+	// only ever replaces a socket, and only one nobody answers on, that
+	// one is left over from a server that didn't get to clean up
+	if(struct stat st; lstat(_path.c_str(), &st) == 0) {
+		if(!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "> Error: %s exists and isn't a socket\n", _path.c_str());
+			return false;
+		}
+
+		if(const int other = Connect(addr); other >= 0) {
+			close(other);
+			fprintf(stderr, "> Error: a server is already listening on %s\n", _path.c_str());
+			return false;
+		}
+
+		unlink(_path.c_str());
+	}
+
+	// whoever can connect can call any extern, so only the owner can
+	const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	const mode_t mask = umask(077);
+	const bool bound = listener >= 0
+		&& bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+	umask(mask);
+
+	if(!bound || listen(listener, SOMAXCONN) < 0) {
+		fprintf(stderr, "> Error: couldn't listen on %s: %s\n", _path.c_str(), strerror(errno));
+		if(listener >= 0)
+			close(listener);
+
+		return false;
+	}
+
+	// a client hanging up halfway through its reply isn't our problem
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "> Serving on %s\n", _path.c_str());
+
+	bool running {true};
+	while(running) {
+		const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if(client < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			fprintf(stderr, "> Error: accept failed: %s\n", strerror(errno));
+			break;
+		}
+
+		const timeval timeout {ClientTimeoutSeconds, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		std::string data;
+		ServerRequest request;
+
+		if(!ReadAll(client, data) || !ParseRequest(std::move(data), request)) {
+			close(client);
+			continue;
+		}
+
+		int status {0};
+		if(request.m_Kind == ServerRequest::Kind::Stop)
+			running = false;
+		else
+			status = HandleWithOutputTo(client, _handler, request);
+
+		const char trailer[2] {'\0', static_cast<char>(status)};
+		WriteAll(client, trailer, sizeof(trailer));
+		close(client);
+	}
+
+	close(listener);
+	unlink(_path.c_str());
+
+	return true;
+}
+
+#pragma endregion
+
+#pragma region CLIENT
+
+int RunClient(const std::string & _path, const ServerRequest::Kind _kind, const std::string & _argument) {
+	sockaddr_un addr;
+	if(!SocketAddress(_path, addr))
+		return 1;
+
+	const int fd = Connect(addr);
+	if(fd < 0) {
+		fprintf(stderr, "> Error: no server on %s: %s\n", _path.c_str(), strerror(errno));
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	const std::string header = std::string {KindNames[static_cast<size_t>(_kind)]} + " " + _argument + "\n";
+	bool sent = WriteAll(fd, header.data(), header.size());
+
+	if(_kind != ServerRequest::Kind::Stop) {
+		char buffer[1 << 16];
+
+		while(sent) {
+			const ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+			if(n < 0 && errno == EINTR)
+				continue;
+
+			if(n <= 0)
+				break;
+
+			sent = WriteAll(fd, buffer, static_cast<size_t>(n));
+		}
+	}
+
+	shutdown(fd, SHUT_WR);
+
+	// the last two bytes are the trailer, everything before them is
+	// passed on as soon as it arrives
+	std::string pending;
+	char buffer[1 << 12];
+
+	while(true) {
+		const ssize_t n = read(fd, buffer, sizeof(buffer));
+		if(n < 0 && errno == EINTR)
+			continue;
+
+		if(n <= 0)
+			break;
+
+		pending.append(buffer, static_cast<size_t>(n));
+		if(pending.size() > 2) {
+			WriteAll(STDERR_FILENO, pending.data(), pending.size() - 2);
+			pending.erase(0, pending.size() - 2);
+		}
+	}
+
+	close(fd);
+
+	if(pending.size() == 2 && pending[0] == '\0')
+		return static_cast<unsigned char>(pending[1]);
+
+	WriteAll(STDERR_FILENO, pending.data(), pending.size());
+	fprintf(stderr, "> Error: the server closed the connection before replying\n");
+
+	return 1;
+}
+
+#pragma endregion
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Compile server. `modk --server <socket>` sets the JIT, the target and
+// everything --load pulled in up once and then keeps taking requests
+// on a Unix domain socket, definitions and compiled code included, so
+// a small compile only pays for itself. `modk --connect <socket>` is
+// the client, it never touches LLVM and just forwards stdin
+//
+// a request is a header line, "<kind> <argument>\n", followed by the
+// source up to the client's end of stream. Whatever the server prints
+// while handling it is sent back as it comes, then a 0 byte and the
+// request's exit status
+//
+// requests are handled one at a time in the order they connect, the
+// compiler's state isn't something two of them could share at once
+struct ServerRequest {
+	enum class Kind : uint8_t {
+		Run,		// definitions and expressions, as if piped to modk
+		EmitObject,	// the request's definitions to <argument>.<n>.o
+		Stop,		// shuts the server down
+	};
+
+	Kind m_Kind {Kind::Run};
+	std::string m_Argument {};
+	std::string m_Source {};
+};
+
+// returns the request's exit status, stdout and stderr go to the
+// client for as long as it runs
+using ServerHandler = std::function<int (const ServerRequest &)>;
+
+// serves requests until one asks it to stop, false if the socket
+// couldn't be set up (another server already listening on it included)
+bool RunServer(const std::string & _path, const ServerHandler & _handler);
+
+// sends stdin as one request, the reply goes to stderr. Returns the
+// request's exit status, or 1 if the server couldn't be reached
+int RunClient(const std::string & _path, const ServerRequest::Kind _kind, const std::string & _argument);
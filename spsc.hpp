@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// spins for a while, then yields, then naps, so an idle stage of the
+// pipeline doesn't eat a whole core waiting on its neighbour
+inline void RingBackoff(unsigned & _spins) {
+	if(++_spins < 64)
+		return;
+
+	if(_spins < 1024)
+		std::this_thread::yield();
+	else
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+// Bounded lock free single producer / single consumer ring. Head and
+// tail sit on their own cache lines so the two threads only ever
+// share the line of the slot being handed over
+template <typename T>
+class SpscRing {
+	std::unique_ptr<T[]> m_Slots;
+	size_t m_Mask {0};
+
+	alignas(64) std::atomic<size_t> m_Head {0};
+	alignas(64) std::atomic<size_t> m_Tail {0};
+
+	public:
+		explicit SpscRing(const size_t _capacity) {
+			size_t size {1};
+			while(size < _capacity)
+				size <<= 1;
+
+			m_Slots = std::make_unique<T[]>(size);
+			m_Mask = size - 1;
+		}
+
+		// only moves out of _value when there was room for it
+		bool tryPush(T && _value) {
+			const size_t tail = m_Tail.load(std::memory_order_relaxed);
+			if(tail - m_Head.load(std::memory_order_acquire) > m_Mask)
+				return false;
+
+			m_Slots[tail & m_Mask] = std::move(_value);
+			m_Tail.store(tail + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		bool tryPop(T & _value) {
+			const size_t head = m_Head.load(std::memory_order_relaxed);
+			if(head == m_Tail.load(std::memory_order_acquire))
+				return false;
+
+			_value = std::move(m_Slots[head & m_Mask]);
+			m_Head.store(head + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		void push(T _value) {
+			unsigned spins {0};
+			while(!tryPush(std::move(_value)))
+				RingBackoff(spins);
+		}
+
+		T pop() {
+			T value {};
+			unsigned spins {0};
+
+			while(!tryPop(value))
+				RingBackoff(spins);
+
+			return value;
+		}
+};